@@ -0,0 +1,111 @@
+/*
+ * Throughput of duplicating one stream to several consumers: mshell's "|>" relay
+ * against the usual tee(1) into named pipes.
+ *
+ *   fanout [-m MIB] [-w WAYS] [-r RUNS] MSHELL
+ *
+ * Both feed WAYS "cat >/dev/null" consumers from "head -c MIB /dev/zero". The FIFO
+ * version runs under /bin/sh, since mshell has no wait, and waits for its consumers
+ * just like the relay does.
+ * Reported are the best wall clock and the CPU time of the whole process tree.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MIB 1024
+#define WAYS 2
+#define RUNS 5
+#define CONSUMER "cat >/dev/null"
+
+static double _now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int _once(const char *shell, const char *cmd, double *wall, double *cpu) {
+    double start = _now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl(shell, shell, "-c", cmd, (char *)NULL);
+        _exit(127);
+    }
+    int status;
+    struct rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return 0;
+    }
+    *wall = _now() - start;
+    // the shell waits for the whole pipeline, so its children's time is in here too
+    *cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    return 1;
+}
+
+static int _report(const char *name, const char *shell, const char *cmd, int runs, int mib) {
+    double best = -1, best_cpu = 0;
+    for (int r = 0; r < runs; r++) {
+        double wall, cpu;
+        if (!_once(shell, cmd, &wall, &cpu)) {
+            fprintf(stderr, "%s: failed: %s\n", name, cmd);
+            return 0;
+        }
+        if (best < 0 || wall < best) {
+            best = wall, best_cpu = cpu;
+        }
+    }
+    printf("%-16s %10.3f %10.3f %10.0f\n", name, best, best_cpu, mib / best);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    int mib = MIB, ways = WAYS, runs = RUNS, opt;
+    while ((opt = getopt(argc, argv, "m:w:r:")) != -1) {
+        switch (opt) {
+            case 'm':
+                mib = atoi(optarg);
+                break;
+            case 'w':
+                ways = atoi(optarg);
+                break;
+            case 'r':
+                runs = atoi(optarg);
+                break;
+            default:
+                optind = argc + 1;
+        }
+    }
+    if (optind != argc - 1 || mib < 1 || ways < 1 || ways > 16 || runs < 1) {
+        fprintf(stderr, "usage: %s [-m MIB] [-w WAYS] [-r RUNS] MSHELL\n", argv[0]);
+        return 2;
+    }
+    const char *shell = argv[optind];
+    char dir[] = "/tmp/fanoutXXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    char relay[4096], fifos[4096];
+    int r = snprintf(relay, sizeof(relay), "head -c %dM /dev/zero |>", mib);
+    int f = snprintf(fifos, sizeof(fifos), "cd %s;", dir);
+    for (int i = 0; i < ways; i++) {
+        r += snprintf(relay + r, sizeof(relay) - r, " (%s)", CONSUMER);
+        f += snprintf(fifos + f, sizeof(fifos) - f, " mkfifo f%d; %s <f%d &", i, CONSUMER, i);
+    }
+    f += snprintf(fifos + f, sizeof(fifos) - f, " head -c %dM /dev/zero | tee", mib);
+    for (int i = 0; i < ways; i++) {
+        f += snprintf(fifos + f, sizeof(fifos) - f, " f%d", i);
+    }
+    snprintf(fifos + f, sizeof(fifos) - f, " >/dev/null; wait; rm f*");
+
+    printf("%d MiB to %d consumers, best of %d\n", mib, ways, runs);
+    printf("%-16s %10s %10s %10s\n", "", "wall s", "cpu s", "MiB/s");
+    int ok = _report("relay |>", shell, relay, runs, mib) && _report("tee + fifos", "/bin/sh", fifos, runs, mib);
+    rmdir(dir);
+    return ok ? 0 : 1;
+}
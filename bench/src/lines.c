@@ -0,0 +1,88 @@
+/*
+ * Cost of one script line, for comparing builds of the shell.
+ *
+ *   lines [-n LINES] SHELL...
+ *
+ * Runs generated scripts of LINES lines each. "parse" lines expand a variable and run a
+ * builtin with a redirection, so nothing is forked. "spawn" lines run /bin/true. The
+ * time of an empty script is subtracted and the rest is divided by the line count.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LINES 5000
+#define RUNS 3
+#define PARSE_LINE "x=$((x + 1)); lecho line $x >/dev/null\n"
+#define SPAWN_LINE "/bin/true\n"
+
+static double _now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int _script(char *path, const char *line, int lines) {
+    FILE *f = fdopen(mkstemp(path), "w");
+    if (f == NULL) {
+        return 0;
+    }
+    for (int i = 0; i < lines; i++) {
+        fputs(line, f);
+    }
+    return fclose(f) == 0;
+}
+
+static double _best(const char *shell, const char *script) { // seconds, -1 on failure
+    double best = -1;
+    for (int r = 0; r < RUNS; r++) {
+        double start = _now();
+        pid_t pid = fork();
+        if (pid == 0) {
+            execl(shell, shell, script, (char *)NULL);
+            _exit(127);
+        }
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            return -1;
+        }
+        double t = _now() - start;
+        best = (best < 0 || t < best ? t : best);
+    }
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    int lines = LINES, i = 1;
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        lines = atoi(argv[2]);
+        i = 3;
+    }
+    if (i >= argc || lines < 1) {
+        fprintf(stderr, "usage: %s [-n LINES] SHELL...\n", argv[0]);
+        return 2;
+    }
+    char empty[] = "/tmp/linesXXXXXX", parse[] = "/tmp/linesXXXXXX", spawn[] = "/tmp/linesXXXXXX";
+    if (!_script(empty, "", 0) || !_script(parse, PARSE_LINE, lines) || !_script(spawn, SPAWN_LINE, lines)) {
+        perror("script");
+        return 1;
+    }
+    int ret = 0;
+    printf("%-32s %14s %14s\n", "shell", "parse us/line", "spawn us/line");
+    for (; i < argc; i++) {
+        double base = _best(argv[i], empty), p = _best(argv[i], parse), s = _best(argv[i], spawn);
+        if (base < 0 || p < 0 || s < 0) {
+            fprintf(stderr, "%s: a script failed\n", argv[i]);
+            ret = 1;
+            continue;
+        }
+        printf("%-32s %14.2f %14.2f\n", argv[i], (p - base) * 1e6 / lines, (s - base) * 1e6 / lines);
+    }
+    unlink(empty);
+    unlink(parse);
+    unlink(spawn);
+    return ret;
+}
@@ -0,0 +1,169 @@
+/*
+ * Requests per second of a warm "mshell --serve" against exec'ing "mshell -c" for each
+ * command line, with the same number of command lines in flight.
+ *
+ *   serve [-n REQUESTS] [-j PARALLEL] MSHELL
+ *
+ * Both run a builtin alone ("true") and an external command ("/bin/true"), with stdin
+ * and stdout on /dev/null and stderr passed through.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mshell_serve.h"
+
+#define REQUESTS 5000
+#define PARALLEL 8
+#define MAX_PARALLEL 256
+
+static const char *commands[] = {"true", "/bin/true", NULL};
+
+static double _now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int _send(const char *path, const char *command, int null_fd) { // the connection, -1 on failure
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    mshell_serve_request req = {.version = MSHELL_SERVE_VERSION, .command_len = strlen(command)};
+    struct iovec iov[2] = {{&req, sizeof(req)}, {(void *)command, req.command_len}};
+    int fds[MSHELL_SERVE_FDS] = {null_fd, null_fd, STDERR_FILENO};
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = 2, .msg_control = control, .msg_controllen = sizeof(control)};
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET, c->cmsg_type = SCM_RIGHTS, c->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(c), fds, sizeof(fds));
+    if (sendmsg(fd, &msg, 0) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static double _served(const char *path, const char *command, int requests, int parallel, int null_fd) { // requests/s
+    struct pollfd pending[MAX_PARALLEL];
+    int sent = 0, done = 0, n = 0;
+    double start = _now();
+    while (done < requests) {
+        while (n < parallel && sent < requests) {
+            if ((pending[n].fd = _send(path, command, null_fd)) < 0) {
+                return -1;
+            }
+            pending[n++].events = POLLIN;
+            sent++;
+        }
+        poll(pending, n, -1);
+        for (int i = 0; i < n; i++) {
+            mshell_serve_reply reply;
+            if (!(pending[i].revents & (POLLIN | POLLHUP))) {
+                continue;
+            }
+            if (recv(pending[i].fd, &reply, sizeof(reply), 0) != sizeof(reply) || reply.status != 0) {
+                return -1;
+            }
+            close(pending[i].fd);
+            pending[i--] = pending[--n];
+            done++;
+        }
+    }
+    return requests / (_now() - start);
+}
+
+static double _execd(const char *shell, const char *command, int requests, int parallel, int null_fd) { // requests/s
+    int started = 0, done = 0, running = 0;
+    double start = _now();
+    while (done < requests) {
+        while (running < parallel && started < requests) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                dup2(null_fd, STDIN_FILENO);
+                dup2(null_fd, STDOUT_FILENO);
+                execl(shell, shell, "-c", command, (char *)NULL);
+                _exit(127);
+            }
+            if (pid < 0) {
+                return -1;
+            }
+            started++, running++;
+        }
+        int status;
+        if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            return -1;
+        }
+        running--, done++;
+    }
+    return requests / (_now() - start);
+}
+
+int main(int argc, char *argv[]) {
+    int requests = REQUESTS, parallel = PARALLEL, opt;
+    while ((opt = getopt(argc, argv, "n:j:")) != -1) {
+        switch (opt) {
+            case 'n':
+                requests = atoi(optarg);
+                break;
+            case 'j':
+                parallel = atoi(optarg);
+                break;
+            default:
+                optind = argc + 1;
+        }
+    }
+    if (optind != argc - 1 || requests < 1 || parallel < 1 || parallel > MAX_PARALLEL) {
+        fprintf(stderr, "usage: %s [-n REQUESTS] [-j PARALLEL] MSHELL\n", argv[0]);
+        return 2;
+    }
+    const char *shell = argv[optind];
+    char dir[] = "/tmp/serveXXXXXX", path[64], jobs[16];
+    if (mkdtemp(dir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/sock", dir);
+    snprintf(jobs, sizeof(jobs), "%d", parallel);
+    pid_t server = fork();
+    if (server == 0) {
+        execl(shell, shell, "--serve", path, "-j", jobs, (char *)NULL);
+        _exit(127);
+    }
+    int null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+    for (int tries = 0; access(path, F_OK) != 0 && tries < 1000; tries++) {
+        usleep(1000);
+    }
+
+    int ret = 0;
+    printf("%d requests, %d in flight\n", requests, parallel);
+    printf("%-12s %14s %14s\n", "command", "--serve req/s", "-c req/s");
+    for (int i = 0; commands[i] != NULL; i++) {
+        double served = _served(path, commands[i], requests, parallel, null_fd);
+        double execd = _execd(shell, commands[i], requests, parallel, null_fd);
+        if (served < 0 || execd < 0) {
+            fprintf(stderr, "%s: a request failed\n", commands[i]);
+            ret = 1;
+            break;
+        }
+        printf("%-12s %14.0f %14.0f\n", commands[i], served, execd);
+    }
+    kill(server, SIGTERM);
+    waitpid(server, NULL, 0);
+    unlink(path);
+    rmdir(dir);
+    return ret;
+}
@@ -0,0 +1,92 @@
+/*
+ * Startup latency of a shell used as SHELL by make or a job runner: the time from
+ * exec'ing "SHELL -c CMD" to the first command it runs getting control.
+ *
+ *   startup [-n RUNS] SHELL...
+ *
+ * CMD is this program again with --stamp; it writes the monotonic clock to the pipe
+ * it inherits, the parent subtracts the time it took right before fork.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define STAMP_FD 3
+#define RUNS 200
+
+static long long _now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int _cmp(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+static long long _once(const char *shell, const char *cmd) { // ns, -1 on failure
+    int fd[2];
+    if (pipe(fd) < 0) {
+        return -1;
+    }
+    long long start = _now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(fd[1], STAMP_FD);
+        execl(shell, shell, "-c", cmd, (char *)NULL);
+        _exit(127);
+    }
+    close(fd[1]);
+    long long stamp = -1;
+    if (pid < 0 || read(fd[0], &stamp, sizeof(stamp)) != sizeof(stamp)) {
+        stamp = -1;
+    }
+    close(fd[0]);
+    waitpid(pid, NULL, 0);
+    return stamp < 0 ? -1 : stamp - start;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc == 2 && strcmp(argv[1], "--stamp") == 0) {
+        long long now = _now();
+        return write(STAMP_FD, &now, sizeof(now)) == sizeof(now) ? 0 : 1;
+    }
+    int runs = RUNS, i = 1;
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        runs = atoi(argv[2]);
+        i = 3;
+    }
+    if (i >= argc || runs < 1) {
+        fprintf(stderr, "usage: %s [-n RUNS] SHELL...\n", argv[0]);
+        return 2;
+    }
+    char self[4096], cmd[4200];
+    ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    if (len < 0) {
+        perror("readlink");
+        return 1;
+    }
+    self[len] = '\0';
+    snprintf(cmd, sizeof(cmd), "%s --stamp", self);
+
+    long long *t = malloc(runs * sizeof(long long));
+    printf("%-24s %10s %10s %10s\n", "shell", "min us", "median us", "mean us");
+    for (; i < argc; i++) {
+        long long sum = 0;
+        for (int r = 0; r < runs; r++) {
+            if ((t[r] = _once(argv[i], cmd)) < 0) {
+                fprintf(stderr, "%s: no stamp received\n", argv[i]);
+                return 1;
+            }
+            sum += t[r];
+        }
+        qsort(t, runs, sizeof(long long), _cmp);
+        printf("%-24s %10.1f %10.1f %10.1f\n", argv[i], t[0] / 1e3, t[runs / 2] / 1e3, sum / 1e3 / runs);
+    }
+    free(t);
+    return 0;
+}
@@ -0,0 +1,20 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+#define ARENA_NEW(a, type) ((type *)arena_alloc((a), sizeof(type)))
+
+typedef struct arena_chunk arena_chunk;
+
+typedef struct {
+    arena_chunk *head;
+} arena;
+
+void arena_init(arena *);
+void *arena_alloc(arena *, size_t);
+char *arena_strdup(arena *, const char *);
+void arena_reset(arena *);
+void arena_free(arena *);
+
+#endif /* !_ARENA_H_ */
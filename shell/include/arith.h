@@ -0,0 +1,11 @@
+#ifndef _ARITH_H_
+#define _ARITH_H_
+
+/*
+ * Integer arithmetic for $((...)) and let: 64-bit, C operator precedence, names
+ * are read from and assigned to shell variables.
+ */
+
+int arith_eval(const char *, long long *);
+
+#endif /* !_ARITH_H_ */
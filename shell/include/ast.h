@@ -0,0 +1,34 @@
+#ifndef _AST_H_
+#define _AST_H_
+
+#include "arena.h"
+#include "siparse.h"
+
+/*
+ * Control flow sits on top of siparse: a unit of input is split into plain command
+ * lines, which siparse parses once, and if/while/for nodes linking them together.
+ */
+
+enum { NODE_LINE, NODE_ERROR, NODE_IF, NODE_WHILE, NODE_FOR, NODE_FUNC };
+
+typedef struct node node;
+
+struct node {
+    int type;
+    node *next;
+    pipelineseq *line;          // NODE_LINE
+    node *cond, *body, *orelse; // NODE_IF: cond/then/else, NODE_WHILE: cond/body, NODE_FOR and NODE_FUNC: body
+    char *var;                  // NODE_FOR, the name for NODE_FUNC
+    argseq *words;              // NODE_FOR, NULL for an empty list
+};
+
+typedef char *(*ast_reader)(void *);
+
+node *ast_parse(char *, ast_reader, void *, arena *);
+void ast_run(node *);
+void ast_runInput(node *, int);
+node *ast_copy(node *, arena *);
+
+extern int loop_depth, loop_break, loop_continue;
+
+#endif /* !_AST_H_ */
@@ -8,6 +8,8 @@ typedef struct {
     int (*fun)(char **);
 } builtin_pair;
 
+builtin_pair *builtins_find(const char *);
+
 extern builtin_pair builtins_table[];
 
 #endif /* !_BUILTINS_H_ */
@@ -0,0 +1,7 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+void cache_runScript(char *);
+void cache_runString(char *);
+
+#endif /* !_CACHE_H_ */
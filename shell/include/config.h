@@ -7,28 +7,77 @@
 #define PATH_MAX 4096
 #define HOST_NAME_MAX 64
 #define HISTORY_STARTSIZE 2
+#define SHARED_HISTORY_ENV "MSHELL_SHARED_HISTORY"
+#define SHARED_HISTORY_SIZE (1024 * 1024) // a multiple of 16
+#define ARENA_CHUNK 4096
+#define CAPTURE_READ (64 * 1024)
+#define COPY_CHUNK (1024 * 1024 * 1024) // per copy_file_range/splice/sendfile call
+#define COPY_BUFFER (128 * 1024)
+#define METER_INTERVAL 1.0 // seconds between the live reports of lmeter -p
+#define OUT_BUF_MAX (64 * 1024)
+#define OUT_FILE_BLOCKS 16
+#define VARS_BUCKETS 256
+#define MODULE_BUCKETS 64
+#define FUNC_BUCKETS 64
+#define FUNC_DEPTH_MAX 1000 // nested calls, well within the default stack
+#define HIGHLIGHT_BUCKETS 64
+#define BUILTIN_SLOTS 128 // power of two, a few times the number of builtins
+#define VAR_NAME_MAX 256
+#define REDIR_FD_MIN 10
+#define SERVE_WORKERS 64 // requests handled at once by --serve
+#define SERVE_REQUEST_MAX (64 * 1024)
 
 #define EXEC_FAILURE 127
 
 #define EXEC_SUCCESS 0
 
+#define SYNTAX_STATUS 2
+#define SIGNAL_STATUS 128
+#define TIMEOUT_STATUS 124
+
 #define PROMPT_STR "%u at %h in %c\n$ "
 #define PROMPT_STR_2 "$ "
+#define PROMPT_STR_CONT "> "
 
 #define PATH_DELIMITER ":"
+#define CACHE_DIR "mshell"
+#define LPAR_SEPARATOR "::"
+#define LRUN_PIPE "::"
+#define CGROUP_ROOT "/sys/fs/cgroup"
 #define SYNTAX_ERROR_STR "Syntax error."
+#define ARITH_ERROR_STR "Arithmetic error."
 #define WRONG_FILE "no such file or directory"
 #define NO_PERMISSIONS "permission denied"
 #define EXEC_ERROR "exec error"
 #define REDIR_FAIL "unknown redir on file "
+#define BAD_FD "bad file descriptor"
+#define JOB_SETTINGS_FAIL "cannot apply job settings"
+#define CGROUP_NOT_V2 "not a cgroup v2 directory"
 #define FORK_FAIL "fork failure."
 #define PIPE_FAIL "pipe failure."
 #define READ_FAIL "read failure."
+#define ALLOC_FAIL "allocation failure."
+#define CACHE_CORRUPT "corrupt script cache."
+#define MODULE_ABI_MISMATCH "not an mshell module of this version"
+#define MODULE_NO_BUILTIN "no such builtin in the module"
+#define SHARED_HISTORY_FAIL "cannot use as shared history"
+#define FUNC_TOO_DEEP "maximum function nesting exceeded"
+#define PROCESS_SUBST_CONTEXT "process substitution is only allowed in commands"
+#define RELAY_FAIL "fan-out relay failure."
+#define METER_REPORT "lmeter %s: %.1f MiB in %.2f s, %.1f MiB/s, waiting for input %.0f%%, for output %.0f%%%s\n"
+#define MISSING_COMMAND "-c: option requires an argument"
+#define SERVE_USAGE "usage: mshell --serve SOCKET [-j MAX_REQUESTS]"
+#define SERVE_FAIL "cannot serve on"
+#define SERVE_BAD_REQUEST "malformed request"
 #define PROMPT_ERROR "error while getting username/hostname/cwd"
 #define ANSI_COLOR_RESET "\x1b[0m"
 #define ANSI_COLOR_GOLD "\x1b[33m"
 #define ANSI_COLOR_PURPLE "\x1b[35m"
 #define ANSI_COLOR_GREEN "\x1b[32m"
+#define ANSI_COLOR_RED "\x1b[31m"
+#define ANSI_COLOR_CYAN "\x1b[36m"
+#define ANSI_COLOR_GRAY "\x1b[90m"
+#define ANSI_DIM "\x1b[2m"
 
 #define CTRL_C 3
 #define EOT 4
@@ -0,0 +1,40 @@
+#ifndef _EXPAND_H_
+#define _EXPAND_H_
+
+#include "arena.h"
+#include "my_utils.h"
+#include "siparse.h"
+
+/*
+ * siparse splits words on whitespace and operators, so before a line is parsed the
+ * body of every $(...) is packed into a single word: SUBST_OPEN, the body with each
+ * lexer-special character prefixed by SUBST_ESCAPE (and shifted by 0x80), SUBST_CLOSE.
+ * A body that is a single (...) group came from $((...)) and is evaluated in-process.
+ * <(...) and >(...) are packed the same with SUBST_IN or SUBST_OUT right after SUBST_OPEN.
+ * "cmd |> (a) (b)" becomes "cmd | FANOUT_MARK >(a) >(b)", a last stage that the shell
+ * runs itself as the relay feeding every consumer.
+ *
+ * Redirections are taken away from siparse the same way, so that they keep their order
+ * and may name any descriptor: "2>>log" becomes the word REDIR_MARK "2" REDIR_APPEND "log",
+ * "2>&1" becomes REDIR_MARK "2" REDIR_DUP "1".
+ */
+#define SUBST_OPEN '\001'
+#define SUBST_CLOSE '\002'
+#define REDIR_MARK '\003'
+#define SUBST_IN '\004'
+#define SUBST_OUT '\005'
+#define FANOUT_MARK '\006'
+#define SUBST_ESCAPE '\037'
+#define SUBST_SHIFT 0x80
+#define LEXER_SPECIAL "|;<>\n \t&#"
+#define IFS " \t\n"
+#define SPECIAL_VARS "?$#@*0123456789"
+
+int expand_prepareLine(const char *, char *, int);
+int expand_needsPreparing(const char *);
+int expand_isPlain(const char *);
+int expand_isRedirection(const char *);
+char **expand_args(argseq *, arena *);
+char **expand_command(command *, redir_op **, arena *);
+
+#endif /* !_EXPAND_H_ */
@@ -0,0 +1,19 @@
+#ifndef _FUNC_H_
+#define _FUNC_H_
+
+#include "ast.h"
+
+/*
+ * Shell functions, "name() { list; }", in a chained hash table by name. The definition
+ * keeps a copy of the parsed body in an arena of its own, so a call runs the tree
+ * directly in the shell process, with its arguments as $1 and on. A function redefined
+ * while it runs keeps the old body until that call returns.
+ */
+
+void func_define(const char *, node *);
+int func_exists(const char *);
+int func_call(char **);
+
+extern int func_depth, func_return;
+
+#endif /* !_FUNC_H_ */
@@ -0,0 +1,14 @@
+#ifndef _HIGHLIGHT_H_
+#define _HIGHLIGHT_H_
+
+/*
+ * Syntax colouring for the line editor. Tokens are kept between keystrokes and an
+ * edit only re-lexes from the token it touches until the old tokens line up again.
+ */
+
+void highlight_newLine();
+void highlight_set(const char *, int);
+void highlight_edit(const char *, int, int, int, int);
+void highlight_print(const char *, int);
+
+#endif /* !_HIGHLIGHT_H_ */
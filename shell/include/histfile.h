@@ -0,0 +1,15 @@
+#ifndef _HISTFILE_H_
+#define _HISTFILE_H_
+
+/*
+ * History shared by every session that names the same file in SHARED_HISTORY_ENV: a
+ * fixed-size ring in a memory-mapped file. Appending reserves room with one atomic add
+ * and publishes the entry by storing its offset last, so there are no locks and nothing
+ * is ever rewritten; old entries are simply overwritten by later laps.
+ */
+
+int histfile_open(const char *);
+void histfile_append(const char *, int);
+void histfile_read(void (*)(const char *, int));
+
+#endif /* !_HISTFILE_H_ */
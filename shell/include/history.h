@@ -3,10 +3,13 @@
 
 void history_init();
 void history_add(char *, int);
+void history_addDraft(char *, int);
+void history_sync();
 void history_arrowUp();
 void history_arrowDown();
 char *history_getEntry();
 void history_resetPtr();
 int history_isPtrReset();
+char *history_suggest(const char *, int);
 
 #endif /* !_HISTORY_H_ */
@@ -0,0 +1,78 @@
+#ifndef _JOB_H_
+#define _JOB_H_
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <time.h>
+
+/*
+ * Scheduling settings lrun gives to every process the shell starts while they are set:
+ * CPU affinity, nice value, I/O priority and a cgroup v2 directory. The cgroup is joined
+ * at clone time when the kernel allows it, so the child never runs outside of it.
+ */
+
+/*
+ * A deadline from ltimeout: a timerfd the shell polls while it waits for the foreground
+ * pipeline. Without a terminal the pipeline's processes share a group of their own, so that
+ * the signal reaches all of them. Under a terminal they stay in the shell's group, which keeps
+ * ^C and terminal reads working, and the signal goes to each recorded process instead.
+ */
+
+typedef struct {
+    int timer_fd;
+    pid_t owner;                // the shell that watches the timer
+    int signal;
+    struct timespec kill_after; // zero to send only the first signal
+    int own_group;              // 0 when the shell's group has the terminal
+    pid_t group;                // of the pipeline running now, 0 until its first process starts
+    pid_t *pids;                // of the pipeline running now when it has no group of its own
+    int pids_len, pids_size;
+    int adopted;                // pids from before the deadline, the <(...) of ltimeout's own command
+    int expired;                // signals sent so far
+} job_deadline;
+
+enum { METER_OFF, METER_ON, METER_LIVE }; // lmeter's relays between the stages, reporting at the end or also while they run
+
+typedef struct {
+    int has_cpus;
+    cpu_set_t cpus;
+    int has_nice, nice;
+    int ioprio;    // -1 keeps the shell's
+    int cgroup_fd; // -1 for none
+    job_deadline *deadline; // NULL for none
+    int meter;              // METER_* of lmeter
+} job_settings;
+
+/*
+ * Resource usage of finished background jobs, collected with wait4, summed up for the session.
+ */
+
+typedef struct {
+    long jobs;
+    struct timeval real, user, sys;
+    long maxrss; // KiB, of the largest job
+    pid_t maxrss_pid;
+} job_stats;
+
+int job_parseCpus(const char *, cpu_set_t *);
+int job_parseIoprio(const char *, int *);
+int job_openCgroup(const char *, const char *);
+int job_parseDuration(const char *, struct timespec *);
+int job_parseSignal(const char *, int *);
+int job_arm(job_deadline *, const struct timespec *);
+void job_disarm(job_deadline *);
+pid_t job_fork();
+void job_newPipeline();
+void job_group(pid_t);
+void job_adopt(job_deadline *, pid_t);
+void job_apply();
+int job_timerFd();
+void job_expired();
+void job_account(pid_t, const struct timespec *, const struct timespec *, const struct rusage *);
+void job_printUsage(const struct timespec *, const struct timespec *, const struct rusage *);
+void job_printStats();
+
+extern job_settings *job_current;
+
+#endif /* !_JOB_H_ */
@@ -0,0 +1,15 @@
+#ifndef _MODULE_H_
+#define _MODULE_H_
+
+#include "builtins.h"
+
+/*
+ * Builtins loaded from shared objects, kept in a chained hash table by name.
+ */
+
+int module_load(const char *, char **);
+int module_unload(const char *);
+builtin_pair *module_find(const char *);
+void module_list();
+
+#endif /* !_MODULE_H_ */
@@ -0,0 +1,38 @@
+#ifndef _MSHELL_MODULE_H_
+#define _MSHELL_MODULE_H_
+
+#include <stddef.h>
+
+/*
+ * The interface between mshell and builtins loaded with "lenable -f FILE NAME...".
+ * A module is a shared object exporting
+ *
+ *     const mshell_module_info mshell_module = {MSHELL_MODULE_ABI, builtins, init};
+ *
+ * The shell only loads modules built against its own MSHELL_MODULE_ABI; any change to
+ * the structs below bumps it. Builtins run inside the shell and write their output
+ * through host->write, so it is buffered and captured by $(...) like the shell's own.
+ */
+
+#define MSHELL_MODULE_ABI 1
+#define MSHELL_MODULE_SYMBOL "mshell_module"
+
+typedef struct {
+    unsigned abi;
+    void (*write)(const char *, size_t);
+    char *(*getvar)(const char *);
+    void (*setvar)(const char *, const char *);
+} mshell_host;
+
+typedef struct {
+    const char *name;
+    int (*fun)(char **); // gets argv, returns the exit status
+} mshell_builtin;
+
+typedef struct {
+    unsigned abi;
+    const mshell_builtin *builtins;   // ends with {NULL, NULL}
+    int (*init)(const mshell_host *); // may be NULL, non-zero refuses the load
+} mshell_module_info;
+
+#endif /* !_MSHELL_MODULE_H_ */
@@ -0,0 +1,34 @@
+#ifndef _MSHELL_SERVE_H_
+#define _MSHELL_SERVE_H_
+
+#include <stdint.h>
+
+/*
+ * The protocol of "mshell --serve SOCKET", a SOCK_SEQPACKET Unix socket. A client sends
+ * one request per connection, a single packet:
+ *
+ *     mshell_serve_request, then command_len bytes of commands, cwd_len bytes of working
+ *     directory (0 to keep the server's) and env_len bytes of NUL-terminated "NAME=value"
+ *     strings ("NAME" alone unsets it)
+ *
+ * with up to MSHELL_SERVE_FDS descriptors in SCM_RIGHTS becoming the commands' stdin,
+ * stdout and stderr, in that order; the ones not passed stay the server's. The commands
+ * run like "mshell -c", and once all of their processes are gone the server answers with
+ * one mshell_serve_reply. Any change to the structs below bumps MSHELL_SERVE_VERSION.
+ */
+
+#define MSHELL_SERVE_VERSION 1
+#define MSHELL_SERVE_FDS 3
+
+typedef struct {
+    uint32_t version;
+    uint32_t command_len, cwd_len, env_len;
+} mshell_serve_request;
+
+typedef struct {
+    int32_t status;           // as $? would show it, 128 + the signal for a killed shell
+    int64_t user_us, sys_us;  // CPU time of the shell and every process it waited for
+    int64_t maxrss_kb;        // of the largest of them
+} mshell_serve_reply;
+
+#endif /* !_MSHELL_SERVE_H_ */
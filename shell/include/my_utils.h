@@ -1,30 +1,50 @@
 #ifndef _MY_UTILS_H_
 #define _MY_UTILS_H_
 
+#include <sys/resource.h>
+
 #include "siparse.h"
 #include "stdio.h"
 
+enum { REDIR_READ = 'r', REDIR_WRITE = 'w', REDIR_APPEND = 'a', REDIR_RDWR = 'b', REDIR_DUP = 'd', REDIR_KEEP = 'k' };
+
+typedef struct redir_op redir_op;
+
+struct redir_op { // one redirection of a command, in the order they were written
+    int fd, mode;
+    char *target; // file name, or for REDIR_DUP the descriptor to copy, "-" to close fd
+                  // REDIR_KEEP only passes on src, a process substitution's pipe
+    int src;      // the file opened by the shell, -1 until openRedirs
+    redir_op *next;
+};
+
 int min(int, int);
 int max(int, int);
-void prepareArgsArray(char **, const command *);
 int myAtoi(const char *, long *);
 void printError(char *, int);
-int redirectIn(char *);
-int redirectOut(char *, int);
-int processRedirs(command *);
+int openRedirs(redir_op *);
+void closeRedirs(redir_op *);
+int applyRedirs(redir_op *);
 int isBuiltin(char *);
 int callBuiltin(char *, char **);
 int getNullPos(char **);
 void newBgjob(pid_t pid);
-int bgjobFinished(pid_t, int);
+int bgjobFinished(pid_t, int, const struct rusage *);
+int newBgjobTag();
+int setBgjobTag(int);
+int countBgjobs(int);
+pid_t takeFinishedBgjob(int, int *, int *, struct rusage *);
 void blockSigchld();
 void unblockSigchld();
 void restoreSigactions();
+void resumeSigactions();
+void resumeSigchld();
 void prepareEverything();
+void prepareInteractive();
 void processDeadChildren();
-int isReadable(char *);
 int isExecutable(char *);
 
 extern sigset_t EMPTY_SIGSET;
+extern char *ENV_PATH; // looked up by isExecutable
 
 #endif /* !_MY_UTILS_H_ */
@@ -0,0 +1,27 @@
+#ifndef _OUT_H_
+#define _OUT_H_
+
+#include <stddef.h>
+
+/*
+ * Builtins write through this buffer instead of stdio. It is sized for whatever stdout
+ * is and goes out when it fills, before the shell forks or execs, before the terminal
+ * is read and at exit. On a terminal every finished line goes out at once. Errors go
+ * through out_error, which flushes first, so stdout and stderr keep their order.
+ */
+
+typedef struct {
+    char *data;
+    size_t len, size;
+} out_sink;
+
+void out_write(const char *, size_t);
+void out_puts(const char *);
+void out_printf(const char *, ...) __attribute__((format(printf, 1, 2)));
+void out_error(const char *, ...) __attribute__((format(printf, 1, 2)));
+void out_flush();
+void out_retarget();
+int out_direct();
+out_sink *out_capture(out_sink *);
+
+#endif /* !_OUT_H_ */
@@ -0,0 +1,23 @@
+#ifndef _PARSE_H_
+#define _PARSE_H_
+
+#include "arena.h"
+#include "siparse.h"
+
+// appends to the circular lists siparse builds
+#define LIST_APPEND(head, new)                          \
+    do {                                                \
+        if ((head) == NULL) {                           \
+            (new)->next = (new)->prev = (head) = (new); \
+        } else {                                        \
+            (new)->next = (head);                       \
+            (new)->prev = (head)->prev;                 \
+            (head)->prev->next = (new);                 \
+            (head)->prev = (new);                       \
+        }                                               \
+    } while (0)
+
+pipelineseq *parse_line(char *, arena *);
+pipelineseq *parse_copy(pipelineseq *, arena *);
+
+#endif /* !_PARSE_H_ */
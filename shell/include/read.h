@@ -5,7 +5,11 @@
 
 void restoreTerm();
 void saveTerm();
-pipelineseq *read_newLine();
+char *read_scriptLine();
+char *read_newLine();
+char *read_moreLine(void *);
+int read_atEof();
+void read_release();
 
 extern char buf[];
 
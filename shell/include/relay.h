@@ -0,0 +1,25 @@
+#ifndef _RELAY_H_
+#define _RELAY_H_
+
+/*
+ * The relay behind "cmd |> (a) (b)": copies its input pipe to every output with tee(2)
+ * and splice(2), so the data never passes through user space. It moves one chunk at a
+ * time to every consumer, so a slow consumer holds back the producer instead of the
+ * relay buffering for it.
+ *
+ * relay_copy is lcat's copy of one descriptor to another: copy_file_range between
+ * regular files (a reflink or a server-side copy where the filesystem can), splice when
+ * either end is a pipe, sendfile from other files, and a read/write loop when the kernel
+ * refuses all of them.
+ *
+ * relay_meter is the relay lmeter puts between two pipeline stages. It splices the
+ * input to the output and tells apart the time spent waiting for the writer (the stage
+ * before is the slower one) from the time spent waiting for the reader (backpressure,
+ * the stage after is the slower one).
+ */
+
+int relay_run(int, int *, int);
+int relay_copy(int, int);
+int relay_meter(int, int, const char *, int);
+
+#endif /* !_RELAY_H_ */
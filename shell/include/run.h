@@ -1,11 +1,23 @@
 #ifndef _RUN_H_
 #define _RUN_H_
 
+#include <stddef.h>
+
+#include "my_utils.h"
 #include "siparse.h"
 
 void run_sigchldHandler(int);
-pid_t run_command(command *, int, int, int, int, int);
+pid_t run_command(redir_op *, char **, int, int, int, int, int);
 void run_pipeline(pipeline *);
 void run_pipelineseq(pipelineseq *);
+int run_processSubst(char *, int);
+pid_t *run_substs(int *);
+char *run_capture(char *, size_t *);
+void run_exec(char **);
+int run_properPipeline(pipeline *);
+
+extern pid_t last_cmd_pid;
+extern int last_status;
+extern int run_final; // running the last line of non-interactive input
 
 #endif /* !_RUN_H_ */
@@ -0,0 +1,12 @@
+#ifndef _SERVE_H_
+#define _SERVE_H_
+
+/*
+ * mshell --serve SOCKET [-j N]: a warm shell that takes command lines over a Unix socket.
+ * Every accepted connection is handled by a fork of the server, at most N at a time,
+ * which is far cheaper than exec'ing a fresh shell. The protocol is in mshell_serve.h.
+ */
+
+void serve_run(const char *, int);
+
+#endif /* !_SERVE_H_ */
@@ -0,0 +1,11 @@
+#ifndef _VARS_H_
+#define _VARS_H_
+
+char *vars_get(const char *);
+void vars_set(const char *, const char *);
+int vars_isName(const char *, int);
+int vars_assignment(const char *);
+void vars_setArgs(char **);
+char **vars_swapParams(char **);
+
+#endif /* !_VARS_H_ */
@@ -0,0 +1,55 @@
+/*
+ * Example builtin module: "lenable -f bin/lprobe.so lprobe lgetvar".
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mshell_module.h"
+
+static const mshell_host *host;
+
+static int _init(const mshell_host *h) {
+    host = h;
+    return 0;
+}
+
+static int _probe(char *argv[]) { // lprobe: one line of load and memory figures, without a fork
+    (void)argv;
+    char load[64] = "", line[128];
+    long avail = -1;
+    FILE *f = fopen("/proc/loadavg", "r");
+    if (f != NULL) {
+        if (fgets(load, sizeof(load), f) != NULL) {
+            load[strcspn(load, " ")] = '\0'; // the 1 minute average
+        }
+        fclose(f);
+    }
+    if ((f = fopen("/proc/meminfo", "r")) != NULL) {
+        while (fgets(line, sizeof(line), f) != NULL && sscanf(line, "MemAvailable: %ld", &avail) != 1) {
+        }
+        fclose(f);
+    }
+    char out[256];
+    int len = snprintf(out, sizeof(out), "load %s memavail %ld KiB pid %d\n", load, avail, getpid());
+    host->write(out, len);
+    return load[0] != '\0' && avail >= 0 ? 0 : 1;
+}
+
+static int _getvar(char *argv[]) { // lgetvar NAME
+    char *value;
+    if (argv[1] == NULL || (value = host->getvar(argv[1])) == NULL) {
+        return 1;
+    }
+    host->write(value, strlen(value));
+    host->write("\n", 1);
+    return 0;
+}
+
+static const mshell_builtin builtins[] = {
+    {"lprobe", _probe},
+    {"lgetvar", _getvar},
+    {NULL, NULL},
+};
+
+const mshell_module_info mshell_module = {MSHELL_MODULE_ABI, builtins, _init};
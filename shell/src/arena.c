@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "config.h"
+#include "out.h"
+
+#define ARENA_ALIGN 16
+
+struct arena_chunk {
+    arena_chunk *next;
+    size_t used, size;
+    char data[];
+};
+
+static arena_chunk *_newChunk(size_t size, arena_chunk *next) {
+    arena_chunk *chunk = malloc(sizeof(arena_chunk) + size);
+    if (chunk == NULL) {
+        out_error("%s\n", ALLOC_FAIL);
+        exit(EXEC_FAILURE);
+    }
+    chunk->next = next;
+    chunk->used = 0;
+    chunk->size = size;
+    return chunk;
+}
+
+void arena_init(arena *a) {
+    a->head = NULL;
+}
+
+void *arena_alloc(arena *a, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (a->head == NULL || a->head->size - a->head->used < size) {
+        a->head = _newChunk(size > ARENA_CHUNK ? size : ARENA_CHUNK, a->head);
+    }
+    void *p = a->head->data + a->head->used;
+    a->head->used += size;
+    return p;
+}
+
+char *arena_strdup(arena *a, const char *str) {
+    size_t len = strlen(str) + 1;
+    return memcpy(arena_alloc(a, len), str, len);
+}
+
+void arena_reset(arena *a) { // keeps the oldest chunk, so a per-line arena stops calling malloc
+    if (a->head == NULL) {
+        return;
+    }
+    while (a->head->next != NULL) {
+        arena_chunk *tmp = a->head;
+        a->head = a->head->next;
+        free(tmp);
+    }
+    a->head->used = 0;
+}
+
+void arena_free(arena *a) {
+    while (a->head != NULL) {
+        arena_chunk *tmp = a->head;
+        a->head = a->head->next;
+        free(tmp);
+    }
+}
@@ -0,0 +1,265 @@
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arith.h"
+#include "config.h"
+#include "expand.h"
+#include "vars.h"
+
+/*
+ * Precedence climbing over the C operators, lowest first: "," then assignments,
+ * "?:", "||", "&&", "|", "^", "&", equality, comparisons, shifts, "+ -", "* / %"
+ * and the unary "! ~ - +". Nothing is forked, so let i=i+1 costs no process.
+ */
+
+typedef struct {
+    const char *p;
+    int error;
+    int skip; // inside the operand of && || ?: that is not taken: no assignments, no errors
+} _arith;
+
+static const struct {
+    const char *op;
+    int prec;
+} binary_ops[] = {
+    {"||", 1}, {"&&", 2}, {"==", 6}, {"!=", 6}, {"<=", 7}, {">=", 7}, {"<<", 8}, {">>", 8}, {"|", 3}, {"^", 4},
+    {"&", 5},  {"<", 7},  {">", 7},  {"+", 9},  {"-", 9},  {"*", 10}, {"/", 10}, {"%", 10}, {NULL, 0},
+};
+
+static const struct {
+    const char *op, *binary;
+} assign_ops[] = {
+    {"<<=", "<<"}, {">>=", ">>"}, {"+=", "+"}, {"-=", "-"}, {"*=", "*"}, {"/=", "/"},
+    {"%=", "%"},   {"&=", "&"},   {"^=", "^"}, {"|=", "|"}, {"=", NULL}, {NULL, NULL},
+};
+
+static void _skipSpace(_arith *ar) {
+    while (isspace((unsigned char)*ar->p)) {
+        ar->p++;
+    }
+}
+
+static int _accept(_arith *ar, char c) {
+    _skipSpace(ar);
+    if (*ar->p != c) {
+        return 0;
+    }
+    ar->p++;
+    return 1;
+}
+
+static long long _fail(_arith *ar) {
+    if (!ar->skip) {
+        ar->error = 1;
+    }
+    return 0;
+}
+
+static long long _apply(_arith *ar, const char *op, long long a, long long b) {
+    unsigned long long ua = a, ub = b; // wrap around instead of overflowing
+    switch (op[0]) {
+        case '+':
+            return (long long)(ua + ub);
+        case '-':
+            return (long long)(ua - ub);
+        case '*':
+            return (long long)(ua * ub);
+        case '/':
+        case '%':
+            if (b == 0 || (a == LLONG_MIN && b == -1)) {
+                return _fail(ar);
+            }
+            return op[0] == '/' ? a / b : a % b;
+        case '<':
+            return op[1] == '<' ? (long long)(ua << (b & 63)) : op[1] == '=' ? a <= b : a < b;
+        case '>':
+            return op[1] == '>' ? a >> (b & 63) : op[1] == '=' ? a >= b : a > b;
+        case '=':
+            return a == b;
+        case '!':
+            return a != b;
+        case '&':
+            return op[1] == '&' ? a && b : a & b;
+        case '|':
+            return op[1] == '|' ? a || b : a | b;
+        case '^':
+            return a ^ b;
+    }
+    return _fail(ar);
+}
+
+static long long _comma(_arith *);
+static long long _ternary(_arith *);
+
+static int _number(const char *str, long long *value) {
+    char *end;
+    errno = 0;
+    *value = strtoll(str, &end, 0);
+    while (isspace((unsigned char)*end)) {
+        end++;
+    }
+    return errno == 0 && end != str && *end == '\0';
+}
+
+static long long _variable(_arith *ar, const char *name, int len, int assignable) {
+    char buf[VAR_NAME_MAX];
+    if (len >= VAR_NAME_MAX) {
+        return _fail(ar);
+    }
+    memcpy(buf, name, len);
+    buf[len] = '\0';
+    long long value = 0;
+    char *str = vars_get(buf);
+    if (str != NULL && str[0] != '\0' && !_number(str, &value)) {
+        return _fail(ar);
+    }
+
+    _skipSpace(ar);
+    int k = 0;
+    while (assign_ops[k].op != NULL && strncmp(ar->p, assign_ops[k].op, strlen(assign_ops[k].op)) != 0) {
+        k++;
+    }
+    if (!assignable || assign_ops[k].op == NULL || (assign_ops[k].binary == NULL && ar->p[1] == '=')) {
+        return value; // "==" is a comparison
+    }
+    ar->p += strlen(assign_ops[k].op);
+    long long rhs = _ternary(ar);
+    value = (assign_ops[k].binary != NULL ? _apply(ar, assign_ops[k].binary, value, rhs) : rhs);
+    if (!ar->skip && !ar->error) {
+        char num[32];
+        snprintf(num, sizeof(num), "%lld", value);
+        vars_set(buf, num);
+    }
+    return value;
+}
+
+static long long _primary(_arith *ar) {
+    _skipSpace(ar);
+    const char *p = ar->p;
+    if (*p == '(') {
+        ar->p++;
+        long long value = _comma(ar);
+        return _accept(ar, ')') ? value : _fail(ar);
+    }
+    if (isdigit((unsigned char)*p)) {
+        char *end;
+        errno = 0;
+        long long value = strtoll(p, &end, 0);
+        ar->p = end;
+        return errno == 0 && !isalnum((unsigned char)*end) && *end != '_' ? value : _fail(ar);
+    }
+    int assignable = 1;
+    if (*p == '$') { // $name and ${name} read the same variable as a bare name
+        assignable = 0;
+        p++;
+        if (*p != '\0' && strchr(SPECIAL_VARS, *p) != NULL) {
+            ar->p = p + 1;
+            return _variable(ar, p, 1, 0);
+        }
+        if (*p == '{') {
+            const char *end = strchr(p, '}');
+            if (end == NULL) {
+                return _fail(ar);
+            }
+            ar->p = end + 1;
+            return _variable(ar, p + 1, end - p - 1, 0);
+        }
+    }
+    int len = 0;
+    while (isalnum((unsigned char)p[len]) || p[len] == '_') {
+        len++;
+    }
+    if (!vars_isName(p, len)) {
+        ar->error = 1; // a malformed expression is an error even where it is not evaluated
+        return 0;
+    }
+    ar->p = p + len;
+    return _variable(ar, p, len, assignable);
+}
+
+static long long _unary(_arith *ar) {
+    _skipSpace(ar);
+    char c = *ar->p;
+    if (c != '!' && c != '~' && c != '-' && c != '+') {
+        return _primary(ar);
+    }
+    ar->p++;
+    long long value = _unary(ar);
+    switch (c) {
+        case '!':
+            return !value;
+        case '~':
+            return ~value;
+        case '-':
+            return (long long)(0ULL - (unsigned long long)value);
+    }
+    return value;
+}
+
+static int _binaryOp(_arith *ar) { // index of the operator at the cursor, -1 if there is none
+    _skipSpace(ar);
+    for (int i = 0; binary_ops[i].op != NULL; i++) {
+        int len = strlen(binary_ops[i].op);
+        if (strncmp(ar->p, binary_ops[i].op, len) == 0) {
+            return ar->p[len] == '=' && len == 1 ? -1 : i; // "+=" and friends belong to assignments
+        }
+    }
+    return -1;
+}
+
+static long long _binary(_arith *ar, int min_prec) {
+    long long lhs = _unary(ar);
+    int i;
+    while (!ar->error && (i = _binaryOp(ar)) >= 0 && binary_ops[i].prec >= min_prec) {
+        const char *op = binary_ops[i].op;
+        ar->p += strlen(op);
+        int lazy = (strcmp(op, "&&") == 0 && !lhs) || (strcmp(op, "||") == 0 && lhs);
+        ar->skip += lazy;
+        long long rhs = _binary(ar, binary_ops[i].prec + 1);
+        ar->skip -= lazy;
+        lhs = _apply(ar, op, lhs, rhs);
+    }
+    return lhs;
+}
+
+static long long _ternary(_arith *ar) {
+    long long cond = _binary(ar, 1);
+    if (ar->error || !_accept(ar, '?')) {
+        return cond;
+    }
+    ar->skip += !cond;
+    long long a = _comma(ar);
+    ar->skip -= !cond;
+    if (!_accept(ar, ':')) {
+        ar->error = 1;
+        return 0;
+    }
+    ar->skip += !!cond;
+    long long b = _ternary(ar);
+    ar->skip -= !!cond;
+    return cond ? a : b;
+}
+
+static long long _comma(_arith *ar) {
+    long long value = _ternary(ar);
+    while (!ar->error && _accept(ar, ',')) {
+        value = _ternary(ar);
+    }
+    return value;
+}
+
+int arith_eval(const char *expr, long long *value) { // 0 on a syntax error or division by zero
+    _arith ar = {.p = expr, .error = 0, .skip = 0};
+    _skipSpace(&ar);
+    if (*ar.p == '\0') { // $(()) is 0
+        *value = 0;
+        return 1;
+    }
+    *value = _comma(&ar);
+    _skipSpace(&ar);
+    return !ar.error && *ar.p == '\0';
+}
@@ -0,0 +1,463 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "ast.h"
+#include "config.h"
+#include "expand.h"
+#include "func.h"
+#include "my_utils.h"
+#include "out.h"
+#include "parse.h"
+#include "run.h"
+#include "siparse.h"
+#include "vars.h"
+
+enum { KW_NONE, KW_IF, KW_THEN, KW_ELIF, KW_ELSE, KW_FI, KW_WHILE, KW_FOR, KW_IN, KW_DO, KW_DONE, KW_LBRACE, KW_RBRACE };
+
+static const char *keywords[] = {"", "if", "then", "elif", "else", "fi", "while", "for", "in", "do", "done", "{", "}", NULL};
+
+#define KW(k) (1 << (k))
+
+typedef struct {
+    char *pos;     // inside the current line, already prepared by expand_prepareLine
+    ast_reader more;
+    void *ctx;
+    arena *a;
+    int error;
+} _lexer;
+
+int loop_depth = 0, loop_break = 0, loop_continue = 0;
+
+/* lexing */
+
+static void _skipSpace(_lexer *lx) {
+    while (*lx->pos == ' ' || *lx->pos == '\t') {
+        lx->pos++;
+    }
+}
+
+static int _setLine(_lexer *lx, char *raw) {
+    char *line = arena_alloc(lx->a, MAX_LINE_LENGTH + 1);
+    if (!expand_prepareLine(raw, line, MAX_LINE_LENGTH + 1)) {
+        return 0;
+    }
+    char *comment = strchr(line, '#'); // siparse drops everything after it as well
+    if (comment != NULL) {
+        *comment = '\0';
+    }
+    lx->pos = line;
+    return 1;
+}
+
+static int _nextLine(_lexer *lx) { // 0 at EOF
+    char *raw = lx->more(lx->ctx);
+    if (raw == NULL) {
+        return 0;
+    }
+    if (!_setLine(lx, raw)) {
+        lx->error = 1;
+    }
+    return 1;
+}
+
+static int _wordLen(const char *p) {
+    int len = 0;
+    while (p[len] != '\0' && strchr(LEXER_SPECIAL, p[len]) == NULL) {
+        len++;
+    }
+    return len;
+}
+
+static int _keyword(_lexer *lx) {
+    _skipSpace(lx);
+    int len = _wordLen(lx->pos);
+    for (int k = 1; keywords[k] != NULL; k++) {
+        if ((int)strlen(keywords[k]) == len && strncmp(lx->pos, keywords[k], len) == 0) {
+            return k;
+        }
+    }
+    return KW_NONE;
+}
+
+static int _statementKeyword(_lexer *lx) { // "in" is only special inside a for header
+    int kw = _keyword(lx);
+    return kw == KW_IN ? KW_NONE : kw;
+}
+
+static int _functionName(_lexer *lx) { // length of NAME at "NAME() {" or "NAME () {", 0 for anything else
+    _skipSpace(lx);
+    int len = 0;
+    while (isalnum((unsigned char)lx->pos[len]) || lx->pos[len] == '_') {
+        len++;
+    }
+    char *p = lx->pos + len;
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    if (!vars_isName(lx->pos, len) || strncmp(p, "()", 2) != 0 || _wordLen(p) != 2) {
+        return 0;
+    }
+    return len;
+}
+
+static void _consumeWord(_lexer *lx) {
+    _skipSpace(lx);
+    lx->pos += _wordLen(lx->pos);
+}
+
+static int _skipBlank(_lexer *lx) { // moves to the next non-empty line, 0 at EOF
+    _skipSpace(lx);
+    while (*lx->pos == '\0' && !lx->error) {
+        if (!_nextLine(lx)) {
+            return 0;
+        }
+        _skipSpace(lx);
+    }
+    return !lx->error;
+}
+
+static void _expect(_lexer *lx, int kw) {
+    if (lx->error || !_skipBlank(lx) || _keyword(lx) != kw) {
+        lx->error = 1;
+        return;
+    }
+    _consumeWord(lx);
+}
+
+/* parsing */
+
+static node *_newNode(_lexer *lx, int type) {
+    node *n = ARENA_NEW(lx->a, node);
+    memset(n, 0, sizeof(node));
+    n->type = type;
+    return n;
+}
+
+static node *_lineNode(_lexer *lx, char *from, char *to) {
+    if (to - from >= MAX_LINE_LENGTH) {
+        return _newNode(lx, NODE_ERROR);
+    }
+    char text[MAX_LINE_LENGTH + 1];
+    memcpy(text, from, to - from);
+    text[to - from] = '\0';
+    pipelineseq *ln = parse_line(text, lx->a);
+    node *n = _newNode(lx, ln != NULL ? NODE_LINE : NODE_ERROR);
+    n->line = ln;
+    return n;
+}
+
+static node *_parsePlain(_lexer *lx) { // consecutive plain pipelines are parsed together, like a whole line was before
+    char *from = lx->pos;
+    do {
+        while (*lx->pos != '\0' && *lx->pos != ';' && *lx->pos != '&') {
+            lx->pos++;
+        }
+        if (*lx->pos != '\0') {
+            lx->pos++;
+        }
+    } while (*lx->pos != '\0' && _statementKeyword(lx) == KW_NONE && !_functionName(lx));
+    return _lineNode(lx, from, lx->pos);
+}
+
+static node *_parseList(_lexer *, int, int);
+
+static void _endCompound(_lexer *lx) { // after fi/done comes a separator, the end of the line or another keyword
+    _skipSpace(lx);
+    if (*lx->pos == ';') {
+        lx->pos++;
+    } else if (*lx->pos != '\0' && _statementKeyword(lx) == KW_NONE) {
+        lx->error = 1;
+    }
+}
+
+static node *_parseIf(_lexer *lx) { // at "if" or "elif", consumes everything up to the shared "fi"
+    node *n = _newNode(lx, NODE_IF);
+    _consumeWord(lx);
+    n->cond = _parseList(lx, KW(KW_THEN), 0);
+    _expect(lx, KW_THEN);
+    n->body = _parseList(lx, KW(KW_ELIF) | KW(KW_ELSE) | KW(KW_FI), 0);
+    if (n->cond == NULL || n->body == NULL || lx->error) {
+        lx->error = 1;
+        return n;
+    }
+    int kw = _keyword(lx);
+    if (kw == KW_ELIF) {
+        n->orelse = _parseIf(lx);
+        return n;
+    }
+    if (kw == KW_ELSE) {
+        _consumeWord(lx);
+        n->orelse = _parseList(lx, KW(KW_FI), 0);
+        if (n->orelse == NULL) {
+            lx->error = 1;
+        }
+    }
+    _expect(lx, KW_FI);
+    _endCompound(lx);
+    return n;
+}
+
+static node *_parseWhile(_lexer *lx) {
+    node *n = _newNode(lx, NODE_WHILE);
+    _consumeWord(lx);
+    n->cond = _parseList(lx, KW(KW_DO), 0);
+    _expect(lx, KW_DO);
+    n->body = _parseList(lx, KW(KW_DONE), 0);
+    _expect(lx, KW_DONE);
+    if (n->cond == NULL || n->body == NULL) {
+        lx->error = 1;
+    }
+    _endCompound(lx);
+    return n;
+}
+
+static node *_parseFor(_lexer *lx) { // for NAME in WORDS... ; do LIST done
+    node *n = _newNode(lx, NODE_FOR);
+    _consumeWord(lx);
+    _skipSpace(lx);
+    int len = _wordLen(lx->pos);
+    if (!vars_isName(lx->pos, len)) {
+        lx->error = 1;
+        return n;
+    }
+    n->var = arena_alloc(lx->a, len + 1);
+    memcpy(n->var, lx->pos, len);
+    n->var[len] = '\0';
+    lx->pos += len;
+    if (_keyword(lx) != KW_IN) {
+        lx->error = 1;
+        return n;
+    }
+    _consumeWord(lx);
+    while (_skipSpace(lx), (len = _wordLen(lx->pos)) > 0) {
+        argseq *word = ARENA_NEW(lx->a, argseq);
+        word->arg = arena_alloc(lx->a, len + 1);
+        memcpy(word->arg, lx->pos, len);
+        word->arg[len] = '\0';
+        LIST_APPEND(n->words, word);
+        lx->pos += len;
+    }
+    if (*lx->pos == ';') {
+        lx->pos++;
+    } else if (*lx->pos != '\0') {
+        lx->error = 1;
+        return n;
+    }
+    _expect(lx, KW_DO);
+    n->body = _parseList(lx, KW(KW_DONE), 0);
+    _expect(lx, KW_DONE);
+    if (n->body == NULL) {
+        lx->error = 1;
+    }
+    _endCompound(lx);
+    return n;
+}
+
+static node *_parseFunction(_lexer *lx, int len) { // NAME() { LIST }, the body may start on a later line
+    node *n = _newNode(lx, NODE_FUNC);
+    n->var = arena_alloc(lx->a, len + 1);
+    memcpy(n->var, lx->pos, len);
+    n->var[len] = '\0';
+    lx->pos = strchr(lx->pos + len, ')') + 1;
+    _expect(lx, KW_LBRACE);
+    n->body = _parseList(lx, KW(KW_RBRACE), 0);
+    _expect(lx, KW_RBRACE);
+    if (n->body == NULL) {
+        lx->error = 1;
+    }
+    _endCompound(lx);
+    return n;
+}
+
+static node *_parseList(_lexer *lx, int terminators, int toplevel) { // top level ends with the line, blocks pull more lines
+    node *head = NULL, **tail = &head;
+    while (!lx->error) {
+        _skipSpace(lx);
+        if (*lx->pos == '\0') {
+            if (toplevel) {
+                break;
+            }
+            if (!_skipBlank(lx)) { // EOF inside a block
+                lx->error = 1;
+                break;
+            }
+            continue;
+        }
+        int kw = _statementKeyword(lx);
+        if (kw != KW_NONE && (KW(kw) & terminators)) {
+            break;
+        }
+        node *n;
+        int name = (kw == KW_NONE ? _functionName(lx) : 0);
+        if (name > 0) {
+            n = _parseFunction(lx, name);
+        } else if (kw == KW_IF) {
+            n = _parseIf(lx);
+        } else if (kw == KW_WHILE) {
+            n = _parseWhile(lx);
+        } else if (kw == KW_FOR) {
+            n = _parseFor(lx);
+        } else if (kw == KW_NONE) {
+            n = _parsePlain(lx);
+        } else { // a stray then/fi/done...
+            lx->error = 1;
+            break;
+        }
+        *tail = n;
+        tail = &n->next;
+    }
+    return head;
+}
+
+node *ast_parse(char *line, ast_reader more, void *ctx, arena *a) {
+    _lexer lx = {.more = more, .ctx = ctx, .a = a, .error = 0};
+    if (!_setLine(&lx, line)) {
+        return _newNode(&lx, NODE_ERROR);
+    }
+    node *head = _parseList(&lx, 0, 1);
+    return lx.error ? _newNode(&lx, NODE_ERROR) : head;
+}
+
+/* running */
+
+static int _jumping() { // break, continue or return cut the list short
+    return loop_break || loop_continue || func_return;
+}
+
+static int _loopJumped() { // handles break/continue at the end of an iteration, 1 if the loop is over
+    if (func_return) {
+        return 1;
+    }
+    if (loop_break) {
+        loop_break--;
+        return 1;
+    }
+    if (loop_continue) {
+        return --loop_continue > 0;
+    }
+    return 0;
+}
+
+static void _runWhile(node *n) {
+    int status = EXEC_SUCCESS;
+    loop_depth++;
+    while (1) {
+        ast_run(n->cond);
+        if (_jumping()) {
+            if (_loopJumped()) {
+                break;
+            }
+            continue;
+        }
+        if (last_status != EXEC_SUCCESS) {
+            break;
+        }
+        ast_run(n->body);
+        status = last_status;
+        if (_loopJumped()) {
+            break;
+        }
+    }
+    loop_depth--;
+    if (!func_return) { // else the status is return's
+        last_status = status;
+    }
+}
+
+static void _runFor(node *n) {
+    int status = EXEC_SUCCESS;
+    arena a;
+    arena_init(&a);
+    char **values = (n->words != NULL ? expand_args(n->words, &a) : (char *[]){NULL});
+    loop_depth++;
+    for (int i = 0; values[i] != NULL; i++) {
+        vars_set(n->var, values[i]);
+        ast_run(n->body);
+        status = last_status;
+        if (_loopJumped()) {
+            break;
+        }
+    }
+    loop_depth--;
+    arena_free(&a);
+    last_status = status;
+}
+
+static void _runNode(node *n) {
+    switch (n->type) {
+        case NODE_LINE:
+            run_pipelineseq(n->line);
+            break;
+        case NODE_ERROR:
+            out_error("%s\n", SYNTAX_ERROR_STR);
+            last_status = SYNTAX_STATUS;
+            break;
+        case NODE_IF:
+            ast_run(n->cond);
+            if (_jumping()) {
+                return;
+            }
+            if (last_status == EXEC_SUCCESS) {
+                ast_run(n->body);
+            } else if (n->orelse != NULL) {
+                ast_run(n->orelse);
+            } else {
+                last_status = EXEC_SUCCESS;
+            }
+            break;
+        case NODE_WHILE:
+            _runWhile(n);
+            break;
+        case NODE_FOR:
+            _runFor(n);
+            break;
+        case NODE_FUNC:
+            func_define(n->var, n->body);
+            last_status = EXEC_SUCCESS;
+            break;
+    }
+}
+
+void ast_run(node *n) {
+    for (; n != NULL && !_jumping(); n = n->next) {
+        _runNode(n);
+    }
+}
+
+void ast_runInput(node *n, int final) { // with nothing after this input the last command may replace the shell
+    for (; n != NULL; n = n->next) {
+        run_final = final && n->next == NULL && n->type == NODE_LINE;
+        _runNode(n);
+    }
+    run_final = 0;
+}
+
+node *ast_copy(node *n, arena *a) { // the whole list, for a tree that has to outlive its line
+    node *head = NULL, **tail = &head;
+    for (; n != NULL; n = n->next) {
+        node *c = ARENA_NEW(a, node);
+        *c = *n;
+        c->next = NULL;
+        c->line = parse_copy(n->line, a);
+        c->cond = ast_copy(n->cond, a);
+        c->body = ast_copy(n->body, a);
+        c->orelse = ast_copy(n->orelse, a);
+        c->var = (n->var != NULL ? arena_strdup(a, n->var) : NULL);
+        c->words = NULL;
+        argseq *word = n->words;
+        if (word != NULL) {
+            do {
+                argseq *new = ARENA_NEW(a, argseq);
+                new->arg = arena_strdup(a, word->arg);
+                LIST_APPEND(c->words, new);
+                word = word->next;
+            } while (word != n->words);
+        }
+        *tail = c;
+        tail = &c->next;
+    }
+    return head;
+}
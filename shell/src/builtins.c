@@ -1,19 +1,54 @@
+#include <ctype.h>
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include "arena.h"
+#include "arith.h"
+#include "ast.h"
 #include "builtins.h"
 #include "config.h"
+#include "func.h"
+#include "job.h"
+#include "module.h"
 #include "my_utils.h"
+#include "out.h"
+#include "parse.h"
 #include "prompt.h"
+#include "read.h"
+#include "relay.h"
+#include "run.h"
 
 static int __exit(char *[]);
 static int _echo(char *[]);
 static int _cd(char *[]);
 static int _kill(char *[]);
 static int _ls(char *[]);
+static int _lpar(char *[]);
+static int _true(char *[]);
+static int _false(char *[]);
+static int _test(char *[]);
+static int _break(char *[]);
+static int _continue(char *[]);
+static int _return(char *[]);
+static int _let(char *[]);
+static int _exec(char *[]);
+static int _printf(char *[]);
+static int _lrun(char *[]);
+static int _ulimit(char *[]);
+static int _jobstats(char *[]);
+static int _enable(char *[]);
+static int _cat(char *[]);
+static int _timeout(char *[]);
+static int _meter(char *[]);
 static int _undefined(char *[]);
 
 builtin_pair builtins_table[] = {
@@ -23,10 +58,64 @@ builtin_pair builtins_table[] = {
     {"cd", &_cd},
     {"lkill", &_kill},
     {"lls", &_ls},
+    {"lpar", &_lpar},
+    {"true", &_true},
+    {"false", &_false},
+    {"ltest", &_test},
+    {"[", &_test},
+    {"break", &_break},
+    {"continue", &_continue},
+    {"return", &_return},
+    {"let", &_let},
+    {"exec", &_exec},
+    {"printf", &_printf},
+    {"lrun", &_lrun},
+    {"ulimit", &_ulimit},
+    {"ljobstats", &_jobstats},
+    {"lenable", &_enable},
+    {"lcat", &_cat},
+    {"ltimeout", &_timeout},
+    {"lmeter", &_meter},
     {NULL, NULL}};
 
+static builtin_pair *slots[BUILTIN_SLOTS];
+static unsigned slots_seed = 0;
+
+static unsigned _slotHash(const char *name, unsigned seed) {
+    unsigned h = 2166136261u ^ seed;
+    for (; *name; name++) {
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    }
+    return (h ^ h >> 16) & (BUILTIN_SLOTS - 1);
+}
+
+static void _buildSlots() { // a seed with no collisions makes a perfect hash of the static table
+    int collided = 1;
+    while (collided) {
+        slots_seed++;
+        memset(slots, 0, sizeof(slots));
+        collided = 0;
+        for (builtin_pair *b = builtins_table; b->name != NULL && !collided; b++) {
+            builtin_pair **slot = &slots[_slotHash(b->name, slots_seed)];
+            collided = (*slot != NULL);
+            *slot = b;
+        }
+    }
+}
+
+builtin_pair *builtins_find(const char *name) { // one probe for the static builtins, then the loaded ones
+    if (slots_seed == 0) {
+        _buildSlots();
+    }
+    builtin_pair *b = slots[_slotHash(name, slots_seed)];
+    if (b != NULL && strcmp(b->name, name) == 0) {
+        return b;
+    }
+    return module_find(name);
+}
+
 static int _die(char *prog) {
-    fprintf(stderr, "Builtin %s error.\n", prog);
+    out_error("Builtin %s error.\n", prog);
     return BUILTIN_ERROR;
 }
 
@@ -45,13 +134,13 @@ static int __exit(char *argv[]) {
 static int _echo(char *argv[]) {
     int i = 1;
     if (argv[i]) {
-        printf("%s", argv[i++]);
+        out_puts(argv[i++]);
     }
     while (argv[i]) {
-        printf(" %s", argv[i++]);
+        out_write(" ", 1);
+        out_puts(argv[i++]);
     }
-    printf("\n");
-    fflush(stdout);
+    out_write("\n", 1);
     return EXEC_SUCCESS;
 }
 
@@ -70,7 +159,9 @@ static int _cd(char *argv[]) {
         changeCwd();
         return EXEC_SUCCESS;
     }
-    argv[1] = home_dir;
+    if ((argv[1] = getenv("HOME")) == NULL) {
+        return _die("lcd");
+    }
     argv[2] = NULL;
     return _cd(argv);
 }
@@ -118,18 +209,762 @@ static int _ls(char *argv[]) {
     if ((directory = opendir(".")) != NULL) {
         while ((file = readdir(directory)) != NULL) {
             if (file->d_name[0] != '.') {
-                printf("%s\n", file->d_name);
+                out_printf("%s\n", file->d_name);
             }
         }
         closedir(directory);
-        fflush(stdout);
     } else {
         return _die("lls");
     }
     return EXEC_SUCCESS;
 }
 
+typedef struct {
+    char *line;
+    int tag, running, status;
+    pid_t last_pid;
+} lpar_job;
+
+static char *_lparNextLine(char *argv[], int *i, arena *a) { // command lines come as words separated by LPAR_SEPARATOR
+    if (argv[*i] == NULL) {
+        return NULL;
+    }
+    size_t len = 0;
+    int j;
+    for (j = *i; argv[j] && strcmp(argv[j], LPAR_SEPARATOR) != 0; j++) {
+        len += strlen(argv[j]) + 1;
+    }
+    char *line = arena_alloc(a, len + 1);
+    line[0] = '\0';
+    for (int k = *i; k < j; k++) {
+        if (k > *i) {
+            strcat(line, " ");
+        }
+        strcat(line, argv[k]);
+    }
+    *i = j;
+    if (argv[*i]) {
+        (*i)++;
+    }
+    return line;
+}
+
+typedef struct {
+    char buf[BUF_MAX];
+    int beg, end; // the bytes read but not handed out yet
+    int eof;
+} lpar_input;
+
+static char *_lparReadLine(lpar_input *in, arena *a) { // the next line of fd 0, which is not the shell's script input
+    while (1) {
+        char *from = in->buf + in->beg, *newline = memchr(from, '\n', in->end - in->beg);
+        if (newline != NULL || in->end - in->beg == BUF_MAX || (in->eof && in->beg < in->end)) {
+            int len = (newline != NULL ? newline : in->buf + in->end) - from;
+            char *line = arena_alloc(a, len + 1);
+            memcpy(line, from, len);
+            line[len] = '\0';
+            in->beg += len + (newline != NULL);
+            return line;
+        }
+        if (in->eof) {
+            return NULL;
+        }
+        memmove(in->buf, from, in->end - in->beg);
+        in->end -= in->beg, in->beg = 0;
+        ssize_t got = read(STDIN_FILENO, in->buf + in->end, BUF_MAX - in->end);
+        if (got > 0) {
+            in->end += got;
+        } else if (got == 0 || errno != EINTR) {
+            in->eof = 1;
+        }
+    }
+}
+
+static lpar_job *_lparFindJob(lpar_job *jobs, int njobs, int tag) { // tags are handed out in increasing order
+    int lo = 0, hi = njobs - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (jobs[mid].tag == tag) {
+            return jobs + mid;
+        }
+        (jobs[mid].tag < tag ? (lo = mid + 1) : (hi = mid - 1));
+    }
+    return NULL;
+}
+
+static void _lparReap(lpar_job *jobs, int njobs, int *running) {
+    pid_t pid;
+    int tag, status;
+    while ((pid = takeFinishedBgjob(jobs[0].tag, &tag, &status, NULL)) > 0) {
+        lpar_job *job = _lparFindJob(jobs, njobs, tag);
+        if (job == NULL) {
+            continue;
+        }
+        if (pid == job->last_pid) {
+            job->status = status;
+        }
+        if (--job->running == 0) {
+            (*running)--;
+        }
+    }
+}
+
+static int _lpar(char *argv[]) {
+    long jobs_max = sysconf(_SC_NPROCESSORS_ONLN);
+    int i = 1;
+    if (argv[i] && strncmp(argv[i], "-j", 2) == 0) {
+        char *n = argv[i][2] ? argv[i] + 2 : argv[++i];
+        if (n == NULL || !myAtoi(n, &jobs_max) || jobs_max < 1) {
+            return _die("lpar");
+        }
+        i++;
+    }
+    jobs_max = max(jobs_max, 1);
+    int from_args = argv[i] != NULL;
+
+    arena a;
+    arena_init(&a);
+    lpar_job *jobs = NULL;
+    int njobs = 0, jobs_size = 0, running = 0;
+    lpar_input *in = NULL;
+    if (!from_args) {
+        read_release(); // the shell's own input may be fd 0 too, it must not have read ahead of this line
+        in = ARENA_NEW(&a, lpar_input);
+        in->beg = in->end = in->eof = 0;
+    }
+    char *line;
+    while ((line = (from_args ? _lparNextLine(argv, &i, &a) : _lparReadLine(in, &a))) != NULL) {
+        pipelineseq *ln = parse_line(line, &a), *ln_p = ln;
+        if (ln == NULL) {
+            out_error("%s\n", SYNTAX_ERROR_STR);
+            continue;
+        }
+        do { // every pipeline of the line is a separate job
+            pipeline *p = ln_p->pipeline;
+            ln_p = ln_p->next;
+            int r = run_properPipeline(p);
+            if (r == 2) {
+                out_error("%s\n", SYNTAX_ERROR_STR);
+            }
+            if (r != 1 || (p->commands->com == NULL && p->commands->next == p->commands)) {
+                continue;
+            }
+            while (running >= jobs_max) {
+                sigsuspend(&EMPTY_SIGSET);
+                _lparReap(jobs, njobs, &running);
+            }
+            if (njobs == jobs_size) {
+                jobs_size = max(2 * jobs_size, 16);
+                jobs = realloc(jobs, jobs_size * sizeof(lpar_job));
+            }
+            lpar_job *job = jobs + njobs++;
+            job->line = line;
+            job->tag = newBgjobTag();
+            job->status = 0;
+            int old_tag = setBgjobTag(job->tag);
+            p->flags |= INBACKGROUND;
+            run_pipeline(p);
+            setBgjobTag(old_tag);
+            job->last_pid = last_cmd_pid;
+            if ((job->running = countBgjobs(job->tag)) > 0) {
+                running++;
+            }
+        } while (ln_p != ln);
+    }
+    while (running > 0) {
+        sigsuspend(&EMPTY_SIGSET);
+        _lparReap(jobs, njobs, &running);
+    }
+
+    int failed = 0;
+    for (int k = 0; k < njobs; k++) {
+        out_printf("Job %d (%s) ", k + 1, jobs[k].line);
+        if (WIFEXITED(jobs[k].status)) {
+            out_printf("terminated. (exited with status %d)\n", WEXITSTATUS(jobs[k].status));
+        } else {
+            out_printf("terminated. (killed by signal %d)\n", WTERMSIG(jobs[k].status));
+        }
+        failed |= !WIFEXITED(jobs[k].status) || WEXITSTATUS(jobs[k].status) != 0;
+    }
+    free(jobs);
+    arena_free(&a);
+    return failed ? EXIT_FAILURE : EXEC_SUCCESS;
+}
+
+static char *_lrunOption(char *argv[], int *i, const char *name) { // --name VALUE or --name=VALUE
+    int len = strlen(name);
+    if (strncmp(argv[*i], name, len) != 0) {
+        return NULL;
+    }
+    if (argv[*i][len] == '=') {
+        return argv[*i] + len + 1;
+    }
+    if (argv[*i][len] != '\0' || argv[*i + 1] == NULL) {
+        return NULL;
+    }
+    return argv[++*i];
+}
+
+static int _lrunSettings(char *argv[], int *i, job_settings *s) { // up to "--"
+    char *cgroup = NULL, *mem = NULL, *val;
+    long nice;
+    for (; argv[*i] != NULL && strcmp(argv[*i], "--") != 0; (*i)++) {
+        if ((val = _lrunOption(argv, i, "--cpus")) != NULL) {
+            if (!job_parseCpus(val, &s->cpus)) {
+                return 0;
+            }
+            s->has_cpus = 1;
+        } else if ((val = _lrunOption(argv, i, "--nice")) != NULL) {
+            if (!myAtoi(val, &nice)) {
+                return 0;
+            }
+            s->has_nice = 1, s->nice = nice;
+        } else if ((val = _lrunOption(argv, i, "--ioprio")) != NULL) {
+            if (!job_parseIoprio(val, &s->ioprio)) {
+                return 0;
+            }
+        } else if ((val = _lrunOption(argv, i, "--cgroup")) != NULL) {
+            cgroup = val;
+        } else if ((val = _lrunOption(argv, i, "--mem")) != NULL) {
+            mem = val;
+        } else {
+            return 0;
+        }
+    }
+    if (argv[*i] == NULL || (mem != NULL && cgroup == NULL)) { // the limit is the cgroup's memory.max
+        return 0;
+    }
+    (*i)++;
+    if (cgroup != NULL && (s->cgroup_fd = job_openCgroup(cgroup, mem)) < 0) {
+        if (errno == ENOTSUP) {
+            out_error("%s: %s\n", cgroup, CGROUP_NOT_V2);
+        } else {
+            printError(cgroup, 1);
+        }
+        return 0;
+    }
+    return 1;
+}
+
+static int _runWords(char *argv[], int i, job_settings *s) { // the pipeline after "--", with LRUN_PIPE words standing for '|'
+    char line[MAX_LINE_LENGTH + 1] = "";
+    size_t len = 0;
+    for (; argv[i] != NULL; i++) {
+        char *word = (strcmp(argv[i], LRUN_PIPE) == 0 ? "|" : argv[i]);
+        len += strlen(word) + 1;
+        if (len > MAX_LINE_LENGTH) {
+            break;
+        }
+        strcat(line, " ");
+        strcat(line, word);
+    }
+    arena a;
+    arena_init(&a);
+    pipelineseq *ln = (argv[i] == NULL ? parse_line(line, &a) : NULL);
+    int ret = SYNTAX_STATUS, final = run_final;
+    if (ln != NULL) {
+        job_settings *saved = job_current;
+        job_current = s;
+        run_final = 0; // exec'ing the last command would leave the settings behind
+        run_pipelineseq(ln);
+        run_final = final;
+        job_current = saved;
+        ret = last_status;
+    } else {
+        out_error("%s\n", SYNTAX_ERROR_STR);
+    }
+    arena_free(&a);
+    return ret;
+}
+
+static int _lrun(char *argv[]) { // lrun [settings] -- pipeline
+    job_settings s = {.has_cpus = 0, .has_nice = 0, .ioprio = -1, .cgroup_fd = -1};
+    if (job_current != NULL) { // inside ltimeout or lmeter
+        s.deadline = job_current->deadline, s.meter = job_current->meter;
+    }
+    int i = 1;
+    if (!_lrunSettings(argv, &i, &s) || argv[i] == NULL) {
+        if (s.cgroup_fd >= 0) {
+            close(s.cgroup_fd);
+        }
+        return _die("lrun");
+    }
+    int ret = _runWords(argv, i, &s);
+    if (s.cgroup_fd >= 0) {
+        close(s.cgroup_fd);
+    }
+    return ret;
+}
+
+static int _timeout(char *argv[]) { // ltimeout DURATION [-s SIG] [-k KILL_AFTER] -- pipeline
+    job_deadline d = {.timer_fd = -1, .signal = SIGTERM, .group = 0, .pids = NULL, .pids_len = 0, .pids_size = 0, .adopted = 0, .expired = 0};
+    struct timespec after;
+    int i = 2;
+    if (argv[1] == NULL || !job_parseDuration(argv[1], &after)) {
+        return _die("ltimeout");
+    }
+    for (; argv[i] != NULL && strcmp(argv[i], "--") != 0; i += 2) {
+        int ok = (argv[i + 1] != NULL);
+        if (ok && strcmp(argv[i], "-s") == 0) {
+            ok = job_parseSignal(argv[i + 1], &d.signal);
+        } else if (ok && strcmp(argv[i], "-k") == 0) {
+            ok = job_parseDuration(argv[i + 1], &d.kill_after);
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            return _die("ltimeout");
+        }
+    }
+    if (argv[i] == NULL || argv[i + 1] == NULL) {
+        return _die("ltimeout");
+    }
+    job_settings s = {.has_cpus = 0, .has_nice = 0, .ioprio = -1, .cgroup_fd = -1};
+    if (job_current != NULL) { // inside lrun, its settings still apply
+        s = *job_current;
+    }
+    s.deadline = &d;
+    if (!job_arm(&d, &after)) {
+        job_disarm(&d);
+        return _die("ltimeout");
+    }
+    int nsubsts;
+    pid_t *substs = run_substs(&nsubsts);
+    for (int k = 0; k < nsubsts; k++) { // "ltimeout 1 -- cat <(sleep 5)" started them already
+        job_adopt(&d, substs[k]);
+    }
+    int ret = _runWords(argv, i + 1, &s);
+    job_disarm(&d);
+    if (d.expired) { // like timeout(1)
+        return d.expired > 1 ? SIGNAL_STATUS + SIGKILL : TIMEOUT_STATUS;
+    }
+    return ret;
+}
+
+static int _meter(char *argv[]) { // lmeter [-p] -- pipeline, -p reports while the pipeline runs too
+    job_settings s = {.has_cpus = 0, .has_nice = 0, .ioprio = -1, .cgroup_fd = -1};
+    int i = 1;
+    if (job_current != NULL) { // inside lrun or ltimeout, their settings still apply
+        s = *job_current;
+    }
+    s.meter = METER_ON;
+    if (argv[i] != NULL && strcmp(argv[i], "-p") == 0) {
+        s.meter = METER_LIVE;
+        i++;
+    }
+    if (argv[i] == NULL || strcmp(argv[i], "--") != 0 || argv[i + 1] == NULL) {
+        return _die("lmeter");
+    }
+    return _runWords(argv, i + 1, &s);
+}
+
+static const struct {
+    char opt;
+    int resource;
+    rlim_t unit; // the limit is shown and set in these, as bash does
+    const char *desc;
+} ulimits[] = {
+    {'c', RLIMIT_CORE, 1024, "core file size (KiB)"},
+    {'d', RLIMIT_DATA, 1024, "data seg size (KiB)"},
+    {'f', RLIMIT_FSIZE, 1024, "file size (KiB)"},
+    {'n', RLIMIT_NOFILE, 1, "open files"},
+    {'s', RLIMIT_STACK, 1024, "stack size (KiB)"},
+    {'t', RLIMIT_CPU, 1, "cpu time (seconds)"},
+    {'u', RLIMIT_NPROC, 1, "max user processes"},
+    {'v', RLIMIT_AS, 1024, "virtual memory (KiB)"},
+    {0, 0, 0, NULL},
+};
+
+static void _ulimitShow(int k, int hard, int with_desc) {
+    struct rlimit rl;
+    getrlimit(ulimits[k].resource, &rl);
+    rlim_t v = (hard ? rl.rlim_max : rl.rlim_cur);
+    if (with_desc) {
+        out_printf("%-24s(-%c) ", ulimits[k].desc, ulimits[k].opt);
+    }
+    if (v == RLIM_INFINITY) {
+        out_puts("unlimited\n");
+    } else {
+        out_printf("%llu\n", (unsigned long long)(v / ulimits[k].unit));
+    }
+}
+
+static int _ulimit(char *argv[]) { // ulimit [-H|-S] [-a | -cdfnstuv] [VALUE|unlimited], -f by default
+    int hard = 0, soft = 0, all = 0, k = 2, i = 1;
+    for (; argv[i] != NULL && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        for (char *c = argv[i] + 1; *c; c++) {
+            int j = 0;
+            while (ulimits[j].opt != 0 && ulimits[j].opt != *c) {
+                j++;
+            }
+            if (*c == 'H') {
+                hard = 1;
+            } else if (*c == 'S') {
+                soft = 1;
+            } else if (*c == 'a') {
+                all = 1;
+            } else if (ulimits[j].opt != 0) {
+                k = j;
+            } else {
+                return _die(argv[0]);
+            }
+        }
+    }
+    if (all) {
+        for (int j = 0; ulimits[j].opt != 0; j++) {
+            _ulimitShow(j, hard, 1);
+        }
+        return argv[i] == NULL ? EXEC_SUCCESS : _die(argv[0]);
+    }
+    if (argv[i] == NULL) {
+        _ulimitShow(k, hard, 0);
+        return EXEC_SUCCESS;
+    }
+    long value = 0;
+    int unlimited = strcmp(argv[i], "unlimited") == 0;
+    if (argv[i + 1] != NULL || (!unlimited && (!myAtoi(argv[i], &value) || value < 0))) {
+        return _die(argv[0]);
+    }
+    struct rlimit rl;
+    getrlimit(ulimits[k].resource, &rl);
+    rlim_t v = (unlimited ? RLIM_INFINITY : (rlim_t)value * ulimits[k].unit);
+    if (hard || !soft) { // neither flag sets both, like bash
+        rl.rlim_max = v;
+    }
+    if (soft || !hard) {
+        rl.rlim_cur = v;
+    }
+    return setrlimit(ulimits[k].resource, &rl) < 0 ? _die(argv[0]) : EXEC_SUCCESS;
+}
+
+static int _jobstats(char *argv[]) { // totals over the background jobs finished in this session
+    if (argv[1] != NULL) {
+        return _die(argv[0]);
+    }
+    processDeadChildren(); // so jobs that just finished are counted
+    job_printStats();
+    return EXEC_SUCCESS;
+}
+
+static int _enable(char *argv[]) { // lenable [-f FILE NAME... | -d NAME...], lists loaded builtins without arguments
+    if (argv[1] == NULL) {
+        module_list();
+        return EXEC_SUCCESS;
+    }
+    if (strcmp(argv[1], "-f") == 0 && argv[2] != NULL && argv[3] != NULL) {
+        for (int i = 3; argv[i] != NULL; i++) {
+            builtin_pair *b = builtins_find(argv[i]);
+            if (b != NULL && module_find(argv[i]) != b) { // the shell's own cannot be replaced
+                return _die(argv[0]);
+            }
+        }
+        return module_load(argv[2], argv + 3) ? EXEC_SUCCESS : _die(argv[0]);
+    }
+    if (strcmp(argv[1], "-d") == 0 && argv[2] != NULL) {
+        int ok = 1;
+        for (int i = 2; argv[i] != NULL; i++) {
+            ok &= module_unload(argv[i]);
+        }
+        return ok ? EXEC_SUCCESS : _die(argv[0]);
+    }
+    return _die(argv[0]);
+}
+
+static int _catFile(int fd) { // -1 with errno on failure
+    if (out_direct()) {
+        return relay_copy(fd, STDOUT_FILENO);
+    }
+    char buf[CAPTURE_READ]; // $(lcat f) goes to memory
+    ssize_t got;
+    while ((got = read(fd, buf, sizeof(buf))) != 0) {
+        if (got < 0 && errno != EINTR) {
+            return -1;
+        }
+        out_write(buf, got > 0 ? got : 0);
+    }
+    return 0;
+}
+
+static int _cat(char *argv[]) { // lcat [FILE...], no file or "-" is stdin
+    static char *from_stdin[] = {"-", NULL};
+    char **files = (argv[1] != NULL ? argv + 1 : from_stdin);
+    int ret = EXEC_SUCCESS;
+    for (int i = 0; files[i] != NULL; i++) {
+        int fd = (strcmp(files[i], "-") == 0 ? STDIN_FILENO : open(files[i], O_RDONLY | O_CLOEXEC));
+        if (fd == STDIN_FILENO) {
+            read_release();
+        }
+        if (fd < 0) {
+            printError(files[i], 0);
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        if (_catFile(fd) < 0) {
+            out_error("%s: %s\n", files[i], READ_FAIL);
+            ret = EXIT_FAILURE;
+        }
+        if (fd != STDIN_FILENO) {
+            close(fd);
+        }
+    }
+    return ret;
+}
+
+static int _true(char *argv[]) {
+    (void)argv;
+    return EXEC_SUCCESS;
+}
+
+static int _false(char *argv[]) {
+    (void)argv;
+    return EXIT_FAILURE;
+}
+
+static int _testUnary(char *op, char *arg) {
+    struct stat st;
+    if (op[0] != '-' || op[1] == '\0' || op[2] != '\0') {
+        return -1;
+    }
+    switch (op[1]) {
+        case 'n':
+            return arg[0] != '\0';
+        case 'z':
+            return arg[0] == '\0';
+        case 'e':
+            return stat(arg, &st) == 0;
+        case 'f':
+            return stat(arg, &st) == 0 && S_ISREG(st.st_mode);
+        case 'd':
+            return stat(arg, &st) == 0 && S_ISDIR(st.st_mode);
+        case 's':
+            return stat(arg, &st) == 0 && st.st_size > 0;
+        case 'r':
+            return access(arg, R_OK) == 0;
+        case 'w':
+            return access(arg, W_OK) == 0;
+        case 'x':
+            return access(arg, X_OK) == 0;
+    }
+    return -1;
+}
+
+static int _testBinary(char *a, char *op, char *b) {
+    static const char *int_ops[] = {"-eq", "-ne", "-lt", "-le", "-gt", "-ge", NULL};
+    if (strcmp(op, "=") == 0) {
+        return strcmp(a, b) == 0;
+    }
+    if (strcmp(op, "!=") == 0) {
+        return strcmp(a, b) != 0;
+    }
+    long x, y;
+    for (int i = 0; int_ops[i] != NULL; i++) {
+        if (strcmp(op, int_ops[i]) == 0) {
+            if (!myAtoi(a, &x) || !myAtoi(b, &y)) {
+                return -1;
+            }
+            int r[] = {x == y, x != y, x < y, x <= y, x > y, x >= y};
+            return r[i];
+        }
+    }
+    return -1;
+}
+
+static int _test(char *argv[]) {
+    int argc = getNullPos(argv), i = 1, negate = 0, r;
+    if (strcmp(argv[0], "[") == 0 && (argc < 2 || strcmp(argv[--argc], "]") != 0)) {
+        return _die(argv[0]);
+    }
+    if (argc - i > 1 && strcmp(argv[i], "!") == 0) {
+        negate = 1;
+        i++;
+    }
+    switch (argc - i) {
+        case 0:
+            r = 0;
+            break;
+        case 1:
+            r = argv[i][0] != '\0';
+            break;
+        case 2:
+            r = _testUnary(argv[i], argv[i + 1]);
+            break;
+        case 3:
+            r = _testBinary(argv[i], argv[i + 1], argv[i + 2]);
+            break;
+        default:
+            r = -1;
+    }
+    if (r < 0) {
+        return _die(argv[0]);
+    }
+    return r != negate ? EXEC_SUCCESS : EXIT_FAILURE;
+}
+
+static int _loopJump(char *argv[], int *counter) {
+    long n = 1;
+    if (getNullPos(argv) > 2 || (argv[1] && (!myAtoi(argv[1], &n) || n < 1)) || loop_depth == 0) {
+        return _die(argv[0]);
+    }
+    *counter = min(n, loop_depth);
+    return EXEC_SUCCESS;
+}
+
+static int _break(char *argv[]) {
+    return _loopJump(argv, &loop_break);
+}
+
+static int _continue(char *argv[]) {
+    return _loopJump(argv, &loop_continue);
+}
+
+static int _return(char *argv[]) { // return [n], the function's status is n or else the last command's
+    long n = last_status;
+    if (getNullPos(argv) > 2 || (argv[1] && !myAtoi(argv[1], &n)) || func_depth == 0) {
+        return _die(argv[0]);
+    }
+    func_return = 1;
+    return n & 0xff;
+}
+
+static int _let(char *argv[]) { // evaluates every argument, succeeds if the last one is non-zero
+    long long value = 0;
+    if (argv[1] == NULL) {
+        return _die(argv[0]);
+    }
+    for (int i = 1; argv[i] != NULL; i++) {
+        if (!arith_eval(argv[i], &value)) {
+            out_error("%s\n", ARITH_ERROR_STR);
+            return BUILTIN_ERROR;
+        }
+    }
+    return value != 0 ? EXEC_SUCCESS : EXIT_FAILURE;
+}
+
+static int _exec(char *argv[]) {
+    if (argv[1] == NULL) {
+        return EXEC_SUCCESS;
+    }
+    run_exec(argv + 1);
+    if (!is_a_tty) { // like any shell reading a script
+        exit(EXEC_FAILURE);
+    }
+    return EXEC_FAILURE;
+}
+
+static const char *_printfEscape(const char *p, char *c) { // p is at the backslash, returns the last character used
+    static const char *from = "\\abfnrtv\"'", *to = "\\\a\b\f\n\r\t\v\"'";
+    const char *found = (p[1] != '\0' ? strchr(from, p[1]) : NULL);
+    if (found != NULL) {
+        *c = to[found - from];
+        return p + 1;
+    }
+    if ('0' <= p[1] && p[1] <= '7') { // \NNN, and \0NNN as in %b
+        int i = (p[1] == '0' ? 2 : 1), v = 0, end = i + 3;
+        for (; i < end && '0' <= p[i] && p[i] <= '7'; i++) {
+            v = 8 * v + p[i] - '0';
+        }
+        *c = v;
+        return p + i - 1;
+    }
+    *c = '\\';
+    return p;
+}
+
+static void _printfEscapes(const char *str) {
+    for (const char *p = str; *p; p++) {
+        char c = *p;
+        if (c == '\\') {
+            p = _printfEscape(p, &c);
+        }
+        out_write(&c, 1);
+    }
+}
+
+static int _printfNumber(const char *arg, long long *v, int is_unsigned) {
+    char *end;
+    errno = 0;
+    *v = (is_unsigned ? (long long)strtoull(arg, &end, 0) : strtoll(arg, &end, 0));
+    return arg[0] == '\0' || (errno == 0 && *end == '\0');
+}
+
+static int _printfFormat(const char *fmt, char ***args) { // one pass over the format, 0 on a bad conversion or number
+    int ok = 1;
+    for (const char *p = fmt; *p; p++) {
+        char c = *p;
+        int escaped = (c == '\\');
+        if (escaped) {
+            p = _printfEscape(p, &c);
+        }
+        if (c != '%' || escaped) {
+            out_write(&c, 1);
+            continue;
+        }
+        if (p[1] == '%') {
+            out_write("%", 1);
+            p++;
+            continue;
+        }
+        char spec[32] = "%";
+        int n = 1;
+        for (p++; *p && strchr("-+ #0", *p) && n < 8; p++) {
+            spec[n++] = *p;
+        }
+        for (; isdigit((unsigned char)*p) && n < 16; p++) {
+            spec[n++] = *p;
+        }
+        if (*p == '.') {
+            for (spec[n++] = *p++; isdigit((unsigned char)*p) && n < 24; p++) {
+                spec[n++] = *p;
+            }
+        }
+        char *arg = (**args != NULL ? *(*args)++ : "");
+        long long v;
+        switch (*p) {
+            case 's':
+                strcpy(spec + n, "s");
+                out_printf(spec, arg);
+                break;
+            case 'b':
+                _printfEscapes(arg);
+                break;
+            case 'c':
+                strcpy(spec + n, "c");
+                if (arg[0] != '\0') {
+                    out_printf(spec, arg[0]);
+                }
+                break;
+            case 'd':
+            case 'i':
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                ok &= _printfNumber(arg, &v, *p != 'd' && *p != 'i');
+                spec[n++] = 'l', spec[n++] = 'l', spec[n++] = *p, spec[n] = '\0';
+                out_printf(spec, v);
+                break;
+            default:
+                return 0;
+        }
+    }
+    return ok;
+}
+
+static int _printf(char *argv[]) { // the format is reused while arguments are left, as POSIX printf does
+    if (argv[1] == NULL) {
+        return _die("printf");
+    }
+    char **args = argv + 2, **before;
+    do {
+        before = args;
+        if (!_printfFormat(argv[1], &args)) {
+            return _die("printf");
+        }
+    } while (*args != NULL && args != before);
+    return EXEC_SUCCESS;
+}
+
 static int _undefined(char *argv[]) {
-    fprintf(stderr, "Command %s undefined.\n", argv[0]);
+    out_error("Command %s undefined.\n", argv[0]);
     return BUILTIN_ERROR;
 }
@@ -0,0 +1,581 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "ast.h"
+#include "cache.h"
+#include "config.h"
+#include "my_utils.h"
+#include "out.h"
+#include "parse.h"
+#include "prompt.h"
+#include "run.h"
+#include "siparse.h"
+
+/*
+ * Compiled form of a script file.
+ *
+ * The file is a cache_header, the script's path (padded to 8 bytes) and a payload of
+ * records. Records only hold sizes and inline strings, never pointers, so the payload
+ * can be mmap'ed and decoded straight into an arena, one top level record at a time.
+ *
+ *   record   := REC_SYNTAX_ERROR | REC_LINE u16:npipelines pipeline*
+ *             | REC_IF list list list | REC_WHILE list list | REC_FOR str u16:nwords str* list
+ *             | REC_FUNC str list
+ *   list     := u32:nrecords record*
+ *   pipeline := u8:flags u16:ncommands command*
+ *   command  := u8:0 | u8:1 u16:nargs str* u16:nredirs (u8:flags str)*
+ *   str      := u16:len bytes
+ *
+ * Counts and lengths within a line are bounded by MAX_LINE_LENGTH, a block body is not.
+ */
+
+#define CACHE_MAGIC "MSHC"
+#define CACHE_VERSION 6
+
+enum { REC_SYNTAX_ERROR = 1, REC_LINE, REC_IF, REC_WHILE, REC_FOR, REC_FUNC };
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t dev, ino, size;
+    int64_t mtime_sec, mtime_nsec;
+    uint32_t path_len, records;
+    uint64_t payload_len, checksum;
+} cache_header;
+
+typedef struct {
+    char *data;
+    size_t len, size;
+} _cbuf;
+
+typedef struct {
+    const unsigned char *p, *end;
+    int bad;
+} _creader;
+
+typedef struct {
+    char *pos, *end;
+} _lines;
+
+static uint64_t _fnv1a(const void *data, size_t len) {
+    const unsigned char *p = data;
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+/* writing */
+
+static void _put(_cbuf *b, const void *data, size_t len) {
+    if (b->len + len > b->size) {
+        b->size = max(2 * b->size, b->len + len + ARENA_CHUNK);
+        b->data = realloc(b->data, b->size);
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static void _putU8(_cbuf *b, uint8_t v) {
+    _put(b, &v, 1);
+}
+
+static void _putU16(_cbuf *b, uint16_t v) {
+    _put(b, &v, 2);
+}
+
+static void _putU32(_cbuf *b, uint32_t v) {
+    _put(b, &v, 4);
+}
+
+static void _putStr(_cbuf *b, const char *str) {
+    uint16_t len = strlen(str);
+    _putU16(b, len);
+    _put(b, str, len);
+}
+
+static void _putCommand(_cbuf *b, command *com) {
+    _putU8(b, com != NULL);
+    if (com == NULL) {
+        return;
+    }
+    uint16_t cnt = 0;
+    argseq *args = com->args;
+    do {
+        cnt++;
+        args = args->next;
+    } while (args != com->args);
+    _putU16(b, cnt);
+    do {
+        _putStr(b, args->arg);
+        args = args->next;
+    } while (args != com->args);
+
+    cnt = 0;
+    redirseq *redirs = com->redirs;
+    if (redirs != NULL) {
+        do {
+            cnt++;
+            redirs = redirs->next;
+        } while (redirs != com->redirs);
+    }
+    _putU16(b, cnt);
+    while (cnt--) {
+        _putU8(b, redirs->r->flags);
+        _putStr(b, redirs->r->filename);
+        redirs = redirs->next;
+    }
+}
+
+static void _putLine(_cbuf *b, pipelineseq *ln) {
+    uint16_t cnt = 0;
+    pipelineseq *ln_p = ln;
+    do {
+        cnt++;
+        ln_p = ln_p->next;
+    } while (ln_p != ln);
+    _putU8(b, REC_LINE);
+    _putU16(b, cnt);
+    do {
+        commandseq *commands = ln_p->pipeline->commands;
+        _putU8(b, ln_p->pipeline->flags);
+        cnt = 0;
+        do {
+            cnt++;
+            commands = commands->next;
+        } while (commands != ln_p->pipeline->commands);
+        _putU16(b, cnt);
+        do {
+            _putCommand(b, commands->com);
+            commands = commands->next;
+        } while (commands != ln_p->pipeline->commands);
+        ln_p = ln_p->next;
+    } while (ln_p != ln);
+}
+
+static void _putNode(_cbuf *, node *);
+
+static void _putList(_cbuf *b, node *head) {
+    uint32_t cnt = 0;
+    for (node *n = head; n != NULL; n = n->next) {
+        cnt++;
+    }
+    _putU32(b, cnt);
+    for (node *n = head; n != NULL; n = n->next) {
+        _putNode(b, n);
+    }
+}
+
+static void _putNode(_cbuf *b, node *n) {
+    switch (n->type) {
+        case NODE_LINE:
+            _putLine(b, n->line);
+            break;
+        case NODE_ERROR:
+            _putU8(b, REC_SYNTAX_ERROR);
+            break;
+        case NODE_IF:
+            _putU8(b, REC_IF);
+            _putList(b, n->cond);
+            _putList(b, n->body);
+            _putList(b, n->orelse);
+            break;
+        case NODE_WHILE:
+            _putU8(b, REC_WHILE);
+            _putList(b, n->cond);
+            _putList(b, n->body);
+            break;
+        case NODE_FOR: {
+            _putU8(b, REC_FOR);
+            _putStr(b, n->var);
+            uint16_t cnt = 0;
+            argseq *words = n->words;
+            if (words != NULL) {
+                do {
+                    cnt++;
+                    words = words->next;
+                } while (words != n->words);
+            }
+            _putU16(b, cnt);
+            while (cnt--) {
+                _putStr(b, words->arg);
+                words = words->next;
+            }
+            _putList(b, n->body);
+            break;
+        }
+        case NODE_FUNC:
+            _putU8(b, REC_FUNC);
+            _putStr(b, n->var);
+            _putList(b, n->body);
+            break;
+    }
+}
+
+static int _isEmptyLine(node *n) {
+    pipelineseq *ln = n->line;
+    return n->type == NODE_LINE && ln->next == ln && ln->pipeline->commands->com == NULL
+           && ln->pipeline->commands->next == ln->pipeline->commands;
+}
+
+static char *_nextLine(void *ctx) { // reader over the script text, blocks pull their lines through it too
+    _lines *lines = ctx;
+    if (lines->pos >= lines->end) {
+        return NULL;
+    }
+    char *line = lines->pos, *newline = memchr(line, '\n', lines->end - line);
+    char *line_end = (newline != NULL ? newline : lines->end);
+    *line_end = '\0'; // too long lines fail in expand_prepareLine, like read.c refuses them
+    lines->pos = line_end + 1;
+    return line;
+}
+
+static uint32_t _compile(char *text, size_t len, _cbuf *b) { // same line rules as read.c
+    arena a;
+    arena_init(&a);
+    uint32_t records = 0;
+    _lines lines = {text, text + len};
+    char *line;
+    while ((line = _nextLine(&lines)) != NULL) {
+        arena_reset(&a);
+        for (node *n = ast_parse(line, _nextLine, &lines, &a); n != NULL; n = n->next) {
+            if (!_isEmptyLine(n)) {
+                _putNode(b, n);
+                records++;
+            }
+        }
+    }
+    arena_free(&a);
+    return records;
+}
+
+/* reading */
+
+static const unsigned char *_get(_creader *r, size_t len) {
+    if (r->bad || (size_t)(r->end - r->p) < len) {
+        r->bad = 1;
+        return NULL;
+    }
+    const unsigned char *p = r->p;
+    r->p += len;
+    return p;
+}
+
+static uint8_t _getU8(_creader *r) {
+    const unsigned char *p = _get(r, 1);
+    return p != NULL ? *p : 0;
+}
+
+static uint16_t _getU16(_creader *r) {
+    uint16_t v = 0;
+    const unsigned char *p = _get(r, 2);
+    if (p != NULL) {
+        memcpy(&v, p, 2);
+    }
+    return v;
+}
+
+static uint32_t _getU32(_creader *r) {
+    uint32_t v = 0;
+    const unsigned char *p = _get(r, 4);
+    if (p != NULL) {
+        memcpy(&v, p, 4);
+    }
+    return v;
+}
+
+static char *_getStr(_creader *r, arena *a) {
+    uint16_t len = _getU16(r);
+    const unsigned char *p = _get(r, len);
+    char *str = arena_alloc(a, len + 1);
+    if (p != NULL) {
+        memcpy(str, p, len);
+    }
+    str[len] = '\0';
+    return str;
+}
+
+static command *_getCommand(_creader *r, arena *a) {
+    if (!_getU8(r)) {
+        return NULL;
+    }
+    command *com = ARENA_NEW(a, command);
+    com->args = NULL;
+    com->redirs = NULL;
+    for (int cnt = _getU16(r); cnt > 0 && !r->bad; cnt--) {
+        argseq *new = ARENA_NEW(a, argseq);
+        new->arg = _getStr(r, a);
+        LIST_APPEND(com->args, new);
+    }
+    for (int cnt = _getU16(r); cnt > 0 && !r->bad; cnt--) {
+        redirseq *new = ARENA_NEW(a, redirseq);
+        new->r = ARENA_NEW(a, redir);
+        new->r->flags = _getU8(r);
+        new->r->filename = _getStr(r, a);
+        LIST_APPEND(com->redirs, new);
+    }
+    return com->args != NULL ? com : NULL;
+}
+
+static pipelineseq *_getLine(_creader *r, arena *a) {
+    pipelineseq *ln = NULL;
+    for (int cnt = _getU16(r); cnt > 0 && !r->bad; cnt--) {
+        pipelineseq *new = ARENA_NEW(a, pipelineseq);
+        new->pipeline = ARENA_NEW(a, pipeline);
+        new->pipeline->flags = _getU8(r);
+        new->pipeline->commands = NULL;
+        for (int ccnt = _getU16(r); ccnt > 0 && !r->bad; ccnt--) {
+            commandseq *new_com = ARENA_NEW(a, commandseq);
+            new_com->com = _getCommand(r, a);
+            LIST_APPEND(new->pipeline->commands, new_com);
+        }
+        if (new->pipeline->commands == NULL) {
+            r->bad = 1;
+        }
+        LIST_APPEND(ln, new);
+    }
+    return r->bad ? NULL : ln;
+}
+
+static node *_getNode(_creader *, arena *);
+
+static node *_getList(_creader *r, arena *a) {
+    node *head = NULL, **tail = &head;
+    for (uint32_t cnt = _getU32(r); cnt > 0 && !r->bad; cnt--) {
+        *tail = _getNode(r, a);
+        tail = &(*tail)->next;
+    }
+    return head;
+}
+
+static node *_getNode(_creader *r, arena *a) {
+    node *n = ARENA_NEW(a, node);
+    memset(n, 0, sizeof(node));
+    switch (_getU8(r)) {
+        case REC_SYNTAX_ERROR:
+            n->type = NODE_ERROR;
+            break;
+        case REC_LINE:
+            n->type = NODE_LINE;
+            n->line = _getLine(r, a);
+            break;
+        case REC_IF:
+            n->type = NODE_IF;
+            n->cond = _getList(r, a);
+            n->body = _getList(r, a);
+            n->orelse = _getList(r, a);
+            break;
+        case REC_WHILE:
+            n->type = NODE_WHILE;
+            n->cond = _getList(r, a);
+            n->body = _getList(r, a);
+            break;
+        case REC_FOR:
+            n->type = NODE_FOR;
+            n->var = _getStr(r, a);
+            for (int cnt = _getU16(r); cnt > 0 && !r->bad; cnt--) {
+                argseq *new = ARENA_NEW(a, argseq);
+                new->arg = _getStr(r, a);
+                LIST_APPEND(n->words, new);
+            }
+            n->body = _getList(r, a);
+            break;
+        case REC_FUNC:
+            n->type = NODE_FUNC;
+            n->var = _getStr(r, a);
+            n->body = _getList(r, a);
+            break;
+        default:
+            r->bad = 1;
+    }
+    return n;
+}
+
+static void _run(const char *payload, size_t len) {
+    _creader r = {.p = (const unsigned char *)payload, .end = (const unsigned char *)payload + len, .bad = 0};
+    arena a;
+    arena_init(&a);
+    while (r.p < r.end && !r.bad) {
+        processDeadChildren();
+        unblockSigchld(); // let pending SIGCHLDs in, as reading the next line would
+        blockSigchld();
+        arena_reset(&a);
+        node *n = _getNode(&r, &a);
+        if (!r.bad) {
+            ast_runInput(n, r.p == r.end);
+        }
+    }
+    if (r.bad) {
+        out_error("%s\n", CACHE_CORRUPT);
+    }
+    arena_free(&a);
+}
+
+/* cache files */
+
+static int _cachePath(const char *script, char *path, size_t size) {
+    char *dir = getenv("XDG_CACHE_HOME");
+    int len;
+    if (dir != NULL && dir[0] == '/') {
+        len = snprintf(path, size, "%s/%s", dir, CACHE_DIR);
+    } else if ((dir = getenv("HOME")) != NULL) {
+        len = snprintf(path, size, "%s/.cache/%s", dir, CACHE_DIR);
+    } else {
+        return 0;
+    }
+    if (len < 0 || (size_t)len >= size) {
+        return 0;
+    }
+    for (char *p = path + 1; *p; p++) { // mkdir -p
+        if (*p == '/') {
+            *p = '\0';
+            mkdir(path, S_IRWXU);
+            *p = '/';
+        }
+    }
+    if (mkdir(path, S_IRWXU) != 0 && errno != EEXIST) {
+        return 0;
+    }
+    len = snprintf(path + len, size - len, "/%016llx", (unsigned long long)_fnv1a(script, strlen(script)));
+    return len > 0 && (size_t)len < size;
+}
+
+static void _fillKey(cache_header *h, const char *script, struct stat *st) {
+    memset(h, 0, sizeof(cache_header));
+    memcpy(h->magic, CACHE_MAGIC, 4);
+    h->version = CACHE_VERSION;
+    h->dev = st->st_dev;
+    h->ino = st->st_ino;
+    h->size = st->st_size;
+    h->mtime_sec = st->st_mtim.tv_sec;
+    h->mtime_nsec = st->st_mtim.tv_nsec;
+    h->path_len = strlen(script);
+}
+
+static size_t _payloadOffset(uint32_t path_len) {
+    return sizeof(cache_header) + ((path_len + 7) & ~7u);
+}
+
+static char *_load(const char *cache, const char *script, cache_header *key, size_t *map_len) { // NULL if missing, stale or corrupt
+    int fd = open(cache, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    char *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(cache_header)) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    *map_len = st.st_size;
+    cache_header *h = (cache_header *)map;
+    if (memcmp(h, key, offsetof(cache_header, records)) == 0 // magic, version, key and path length
+        && _payloadOffset(h->path_len) + h->payload_len == (size_t)st.st_size
+        && memcmp(map + sizeof(cache_header), script, h->path_len) == 0
+        && _fnv1a(map + _payloadOffset(h->path_len), h->payload_len) == h->checksum) {
+        return map;
+    }
+    munmap(map, st.st_size);
+    return NULL;
+}
+
+static void _store(const char *cache, const char *script, cache_header *h, _cbuf *payload) {
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.%d", cache, getpid()) >= (int)sizeof(tmp)) {
+        return;
+    }
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        return;
+    }
+    static const char padding[8];
+    size_t pad = _payloadOffset(h->path_len) - sizeof(cache_header) - h->path_len;
+    int ok = write(fd, h, sizeof(cache_header)) == sizeof(cache_header)
+             && write(fd, script, h->path_len) == h->path_len
+             && write(fd, padding, pad) == (ssize_t)pad
+             && write(fd, payload->data, payload->len) == (ssize_t)payload->len;
+    close(fd);
+    if (!ok || rename(tmp, cache) != 0) { // readers only ever see complete files
+        unlink(tmp);
+    }
+}
+
+void cache_runString(char *text) { // mshell -c: parsed and run as it goes, there is nothing to cache
+    arena a;
+    arena_init(&a);
+    _lines lines = {text, text + strlen(text)};
+    char *line;
+    while ((line = _nextLine(&lines)) != NULL) {
+        arena_reset(&a);
+        node *n = ast_parse(line, _nextLine, &lines, &a);
+        ast_runInput(n, lines.pos >= lines.end);
+    }
+    arena_free(&a);
+    exit(last_status);
+}
+
+void cache_runScript(char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        printError(path, 0);
+        exit(EXEC_FAILURE);
+    }
+    char script[PATH_MAX], cache[PATH_MAX];
+    if (realpath(path, script) == NULL) {
+        strncpy(script, path, PATH_MAX - 1);
+        script[PATH_MAX - 1] = '\0';
+    }
+    cache_header key;
+    _fillKey(&key, script, &st);
+    int cacheable = S_ISREG(st.st_mode) && _cachePath(script, cache, sizeof(cache));
+
+    size_t map_len;
+    char *map = (cacheable ? _load(cache, script, &key, &map_len) : NULL);
+    if (map != NULL) {
+        close(fd);
+        cache_header *h = (cache_header *)map;
+        _run(map + _payloadOffset(h->path_len), h->payload_len);
+        munmap(map, map_len);
+        exit(last_status);
+    }
+
+    _cbuf text = {NULL, 0, 0}, payload = {NULL, 0, 0};
+    char chunk[BUF_MAX];
+    ssize_t bytes_read;
+    while ((bytes_read = read(fd, chunk, sizeof(chunk))) != 0) {
+        if (bytes_read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes_read < 0) {
+            out_error("%s\n", READ_FAIL);
+            exit(EXEC_FAILURE);
+        }
+        _put(&text, chunk, bytes_read);
+    }
+    close(fd);
+    _put(&text, "", 1); // room for terminating the last line
+    text.len--;
+    key.records = _compile(text.data, text.len, &payload);
+    free(text.data);
+    key.payload_len = payload.len;
+    key.checksum = _fnv1a(payload.data, payload.len);
+    if (cacheable) {
+        _store(cache, script, &key, &payload);
+    }
+    _run(payload.data, payload.len);
+    free(payload.data);
+    exit(last_status);
+}
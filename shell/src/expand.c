@@ -0,0 +1,464 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "arith.h"
+#include "config.h"
+#include "expand.h"
+#include "my_utils.h"
+#include "out.h"
+#include "run.h"
+#include "siparse.h"
+#include "vars.h"
+
+static int _isSpecial(char c) {
+    return c != '\0' && strchr(LEXER_SPECIAL, c) != NULL;
+}
+
+static int _redirection(const char *in, const char *p, int *fd, int *mode) { // length of the operator at p, 0 if there is none
+    const char *q = p;
+    if (p == in || _isSpecial(p[-1])) { // "2>" only counts at the start of a word
+        while (isdigit((unsigned char)*q) && q - p < 9) {
+            q++;
+        }
+    }
+    if (*q != '<' && *q != '>') {
+        return 0;
+    }
+    *fd = (q != p ? atoi(p) : *q == '>');
+    if (q[1] == '&') {
+        *mode = REDIR_DUP;
+    } else if (*q == '>') {
+        *mode = (q[1] == '>' ? REDIR_APPEND : REDIR_WRITE);
+    } else {
+        *mode = (q[1] == '>' ? REDIR_RDWR : REDIR_READ);
+    }
+    return q - p + 1 + (*mode != REDIR_WRITE && *mode != REDIR_READ);
+}
+
+static int _isDupTarget(const char *p) { // a descriptor or "-"
+    const char *q = p;
+    if (*q == '-') {
+        q++;
+    } else {
+        while (isdigit((unsigned char)*q)) {
+            q++;
+        }
+    }
+    return q != p && (*q == '\0' || _isSpecial(*q));
+}
+
+static int _isProcessSubst(const char *p) { // <(...) or >(...)
+    return (p[0] == '<' || p[0] == '>') && p[1] == '(';
+}
+
+static int _isFanout(const char *p) { // "|>" followed by a group, else "|" and a redirection as before
+    if (p[0] != '|' || p[1] != '>') {
+        return 0;
+    }
+    p += 2;
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    return *p == '(';
+}
+
+static int _pack(const char *p, char kind, char *out, int *o, int out_size) { // p is at '(', returns the length used, 0 if unbalanced
+    int depth = 1;
+    const char *q = p + 1;
+    for (; *q && depth; q++) {
+        depth += (*q == '(') - (*q == ')');
+    }
+    if (depth || *o + 2 * (q - p) + 1 >= out_size) {
+        return 0;
+    }
+    out[(*o)++] = SUBST_OPEN;
+    if (kind != '\0') {
+        out[(*o)++] = kind;
+    }
+    for (const char *b = p + 1; b < q - 1; b++) {
+        if (_isSpecial(*b)) {
+            out[(*o)++] = SUBST_ESCAPE;
+            out[(*o)++] = *b + SUBST_SHIFT;
+        } else {
+            out[(*o)++] = *b;
+        }
+    }
+    out[(*o)++] = SUBST_CLOSE;
+    return q - p;
+}
+
+int expand_prepareLine(const char *in, char *out, int out_size) {
+    int o = 0;
+    for (const char *p = in; *p; p++) {
+        if (p[0] == '$' && p[1] == '#') { // $# is not a comment, its '#' is escaped like inside a substitution
+            if (o + 3 >= out_size) {
+                return 0;
+            }
+            out[o++] = '$', out[o++] = SUBST_ESCAPE, out[o++] = '#' + SUBST_SHIFT;
+            p++;
+            continue;
+        }
+        if (*p == '#') { // the rest is a comment anyway
+            int len = strlen(p);
+            if (o + len >= out_size) {
+                return 0;
+            }
+            memcpy(out + o, p, len);
+            o += len;
+            break;
+        }
+        if (*p == SUBST_OPEN) { // packed already: ast.c prepares lines before parse_line sees them
+            const char *end = strchr(p, SUBST_CLOSE);
+            if (end == NULL || o + (end - p) + 1 >= out_size) {
+                return 0;
+            }
+            memcpy(out + o, p, end - p + 1);
+            o += end - p + 1;
+            p = end;
+            continue;
+        }
+        if ((p[0] == '$' && p[1] == '(') || _isProcessSubst(p)) { // packed the same, the kind follows SUBST_OPEN
+            int len = _pack(p + 1, p[0] == '$' ? '\0' : p[0] == '<' ? SUBST_IN : SUBST_OUT, out, &o, out_size);
+            if (len == 0) {
+                return 0;
+            }
+            p += len;
+            continue;
+        }
+        if (_isFanout(p)) { // the groups take the rest of the pipeline
+            if (o + 3 >= out_size) {
+                return 0;
+            }
+            o += sprintf(out + o, "| %c", FANOUT_MARK);
+            p += 2;
+            while (*p == ' ' || *p == '\t' || *p == '(') {
+                if (*p == '(') {
+                    out[o++] = ' ';
+                    int len = _pack(p, SUBST_OUT, out, &o, out_size);
+                    if (len == 0) {
+                        return 0;
+                    }
+                    p += len - 1;
+                }
+                p++;
+            }
+            if (*p != '\0' && *p != ';' && *p != '&' && *p != '#') {
+                return 0;
+            }
+            p--;
+            continue;
+        }
+        int fd, mode, len = _redirection(in, p, &fd, &mode);
+        if (len > 0) {
+            const char *target = p + len;
+            while (*target == ' ' || *target == '\t') {
+                target++;
+            }
+            int subst = (mode != REDIR_DUP && _isProcessSubst(target)); // "< <(cmd)"
+            if (*target == '\0' || (_isSpecial(*target) && !subst) || (mode == REDIR_DUP && !_isDupTarget(target))) {
+                return 0;
+            }
+            if (o + 16 >= out_size) {
+                return 0;
+            }
+            if (o > 0 && !_isSpecial(out[o - 1])) { // "a>f" is the word "a" and a redirection
+                out[o++] = ' ';
+            }
+            o += sprintf(out + o, "%c%d%c", REDIR_MARK, fd, mode);
+            p = target - 1; // the target is copied like the rest of the word
+            continue;
+        }
+        if (o + 1 >= out_size) {
+            return 0;
+        }
+        out[o++] = *p;
+    }
+    out[o] = '\0';
+    return 1;
+}
+
+int expand_needsPreparing(const char *str) {
+    return strstr(str, "$(") != NULL || strstr(str, "$#") != NULL || strpbrk(str, "<>") != NULL;
+}
+
+int expand_isPlain(const char *word) {
+    return strchr(word, SUBST_OPEN) == NULL && strchr(word, '$') == NULL;
+}
+
+int expand_isRedirection(const char *word) {
+    return word[0] == REDIR_MARK;
+}
+
+typedef struct {
+    char **argv;
+    int argc, argv_size;
+    char *word;
+    int len, size, started, no_split;
+    redir_op ***keep; // where process substitutions leave their descriptors, NULL outside of commands
+    arena *a;
+} _words;
+
+static void _putChar(_words *w, char c) {
+    if (w->len + 1 >= w->size) {
+        w->size = max(2 * w->size, MAX_LINE_LENGTH);
+        w->word = realloc(w->word, w->size);
+    }
+    w->word[w->len++] = c;
+    w->started = 1;
+}
+
+static void _pushArg(_words *w, char *arg) {
+    if (w->argc + 1 >= w->argv_size) { // keep room for the terminating NULL
+        int new_size = 2 * w->argv_size;
+        char **new_argv = arena_alloc(w->a, new_size * sizeof(char *));
+        memcpy(new_argv, w->argv, w->argc * sizeof(char *));
+        w->argv = new_argv, w->argv_size = new_size;
+    }
+    w->argv[w->argc++] = arg;
+}
+
+static void _endWord(_words *w) {
+    if (!w->started) {
+        return;
+    }
+    w->word[w->len] = '\0';
+    _pushArg(w, arena_strdup(w->a, w->word));
+    w->len = 0, w->started = 0;
+}
+
+static void _putSplit(_words *w, const char *str, size_t len) { // unquoted, so the text is split into words
+    for (size_t i = 0; i < len; i++) {
+        if (!w->no_split && strchr(IFS, str[i]) != NULL) {
+            _endWord(w);
+        } else {
+            _putChar(w, str[i]);
+        }
+    }
+}
+
+static const char *_variable(const char *p, _words *w) { // p points just after '$', returns the last character used
+    const char *name = p;
+    int len;
+    if (*p == '{') {
+        const char *end = strchr(p, '}');
+        int digits = (end != NULL && end - p > 1 && strspn(p + 1, "0123456789") == (size_t)(end - p - 1)); // ${10}
+        if (end == NULL || !(vars_isName(p + 1, end - p - 1) || digits || (end - p == 2 && strchr(SPECIAL_VARS, p[1])))) {
+            _putChar(w, '$');
+            return p - 1;
+        }
+        name = p + 1, len = end - p - 1, p = end;
+    } else if (*p != '\0' && strchr(SPECIAL_VARS, *p) != NULL) {
+        len = 1;
+    } else if (p[0] == SUBST_ESCAPE && p[1] == (char)('#' + SUBST_SHIFT)) { // $# from expand_prepareLine
+        name = "#", len = 1, p++;
+    } else {
+        for (len = 0; isalnum((unsigned char)p[len]) || p[len] == '_'; len++)
+            ;
+        if (len == 0) {
+            _putChar(w, '$');
+            return p - 1;
+        }
+        p += len - 1;
+    }
+    char buf[VAR_NAME_MAX];
+    if (len >= VAR_NAME_MAX) {
+        return p;
+    }
+    memcpy(buf, name, len);
+    buf[len] = '\0';
+    char *value = vars_get(buf);
+    if (value != NULL) {
+        _putSplit(w, value, strlen(value));
+    }
+    return p;
+}
+
+static int _isArithmetic(const char *body, int len) { // $((...)): the body is one parenthesized group
+    int depth = 0;
+    for (int i = 0; i < len; i++) {
+        depth += (body[i] == '(') - (body[i] == ')');
+        if (depth == 0) {
+            return i > 0 && i == len - 1;
+        }
+    }
+    return 0;
+}
+
+static void _command(char *, int, _words *);
+
+static char *_arithText(const char *p, arena *a) { // $name, ${name} and $(...) are text for the evaluator, as in POSIX
+    _words w = {.argv_size = 2, .no_split = 1, .a = a};
+    w.argv = arena_alloc(a, w.argv_size * sizeof(char *));
+    for (; *p; p++) {
+        int depth = 1;
+        const char *q = p + 2;
+        if (p[0] == '$' && p[1] == '(') {
+            for (; *q && depth; q++) {
+                depth += (*q == '(') - (*q == ')');
+            }
+        }
+        if (p[0] == '$' && p[1] == '(' && depth == 0) {
+            int len = q - p - 3;
+            char *body = malloc(len + 1);
+            memcpy(body, p + 2, len);
+            body[len] = '\0';
+            _command(body, len, &w);
+            free(body);
+            p = q - 1;
+        } else if (*p == '$') {
+            p = _variable(p + 1, &w);
+        } else {
+            _putChar(&w, *p);
+        }
+    }
+    _endWord(&w);
+    free(w.word);
+    return w.argc > 0 ? w.argv[0] : "";
+}
+
+static void _arithmetic(char *body, int len, _words *w) {
+    long long value;
+    body[len - 1] = '\0';
+    char *expr = (strchr(body + 1, '$') != NULL ? _arithText(body + 1, w->a) : body + 1);
+    if (!arith_eval(expr, &value)) {
+        out_error("%s\n", ARITH_ERROR_STR);
+        return;
+    }
+    char num[32];
+    _putSplit(w, num, snprintf(num, sizeof(num), "%lld", value));
+}
+
+static void _command(char *body, int len, _words *w) { // the text between the parentheses of $(...)
+    if (_isArithmetic(body, len)) {
+        _arithmetic(body, len, w);
+        return;
+    }
+    size_t out_len;
+    char *out = run_capture(body, &out_len);
+    while (out_len > 0 && out[out_len - 1] == '\n') {
+        out_len--;
+    }
+    _putSplit(w, out, out_len);
+    free(out);
+}
+
+static void _processSubst(char *body, int reading, _words *w) { // the word gets /dev/fd/N, the command keeps N open
+    if (w->keep == NULL) {
+        out_error("%s\n", PROCESS_SUBST_CONTEXT);
+        return;
+    }
+    int fd = run_processSubst(body, reading);
+    if (fd < 0) {
+        return;
+    }
+    char path[32];
+    snprintf(path, sizeof(path), "/dev/fd/%d", fd);
+    redir_op *op = ARENA_NEW(w->a, redir_op);
+    op->fd = op->src = fd; // applyRedirs leaves it open across exec
+    op->mode = REDIR_KEEP;
+    op->target = arena_strdup(w->a, path);
+    op->next = NULL;
+    **w->keep = op;
+    *w->keep = &op->next;
+    for (char *c = path; *c; c++) {
+        _putChar(w, *c);
+    }
+}
+
+static const char *_substitute(const char *p, _words *w) { // p points just after SUBST_OPEN
+    char kind = (*p == SUBST_IN || *p == SUBST_OUT ? *p++ : '\0');
+    const char *end = strchr(p, SUBST_CLOSE);
+    char *body = malloc(end - p + 1);
+    int len = 0;
+    for (; p < end; p++) {
+        body[len++] = (*p == SUBST_ESCAPE ? *++p - SUBST_SHIFT : *p);
+    }
+    body[len] = '\0';
+    if (kind != '\0') {
+        _processSubst(body, kind == SUBST_IN, w);
+        free(body);
+        return end;
+    }
+    _command(body, len, w);
+    free(body);
+    return end;
+}
+
+static void _expandWord(const char *p, _words *w) {
+    for (; *p; p++) {
+        if (*p == SUBST_OPEN) {
+            p = _substitute(p + 1, w);
+        } else if (*p == '$') {
+            p = _variable(p + 1, w);
+        } else {
+            _putChar(w, *p);
+        }
+    }
+    _endWord(w);
+}
+
+static char *_target(const char *word, redir_op ***keep, arena *a) { // a file name is one word, whatever it expands to
+    if (expand_isPlain(word)) {
+        return (char *)word;
+    }
+    _words w = {.argv_size = 2, .no_split = 1, .keep = keep, .a = a};
+    w.argv = arena_alloc(a, w.argv_size * sizeof(char *));
+    _expandWord(word, &w);
+    free(w.word);
+    return w.argc > 0 ? w.argv[0] : "";
+}
+
+static redir_op **_addRedir(redir_op **tail, int fd, int mode, const char *target, arena *a) {
+    char *file = _target(target, &tail, a); // "< <(cmd)" keeps the pipe before reopening it
+    redir_op *op = ARENA_NEW(a, redir_op);
+    op->fd = fd;
+    op->mode = mode;
+    op->target = file;
+    op->src = -1;
+    op->next = NULL;
+    *tail = op;
+    return &op->next;
+}
+
+static char **_expand(argseq *first, redir_op **tail, arena *a) { // redirection words go to tail, if given
+    _words w = {.argv_size = 16, .keep = (tail != NULL ? &tail : NULL), .a = a};
+    w.argv = arena_alloc(a, w.argv_size * sizeof(char *));
+    argseq *args = first;
+    do {
+        if (tail != NULL && expand_isRedirection(args->arg)) {
+            char *mode;
+            int fd = strtol(args->arg + 1, &mode, 10);
+            tail = _addRedir(tail, fd, *mode, mode + 1, a);
+        } else if (expand_isPlain(args->arg)) {
+            _pushArg(&w, args->arg);
+        } else {
+            w.no_split = vars_assignment(args->arg) > 0; // name=$(...) keeps the whole value
+            _expandWord(args->arg, &w);
+        }
+        args = args->next;
+    } while (args != first);
+    w.argv[w.argc] = NULL;
+    free(w.word);
+    return w.argv;
+}
+
+char **expand_args(argseq *first, arena *a) {
+    return _expand(first, NULL, a);
+}
+
+char **expand_command(command *com, redir_op **redirs, arena *a) {
+    *redirs = NULL;
+    redir_op **tail = redirs;
+    redirseq *r = com->redirs;
+    if (r != NULL) { // lines siparse saw unprepared
+        do {
+            int mode = (IS_RIN(r->r->flags) ? REDIR_READ : IS_RAPPEND(r->r->flags) ? REDIR_APPEND : REDIR_WRITE);
+            tail = _addRedir(tail, mode != REDIR_READ, mode, r->r->filename, a);
+            r = r->next;
+        } while (r != com->redirs);
+    }
+    return _expand(com->args, tail, a);
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "ast.h"
+#include "config.h"
+#include "func.h"
+#include "out.h"
+#include "run.h"
+#include "vars.h"
+
+typedef struct func func;
+
+struct func {
+    char *name;
+    node *body;
+    arena a;      // owns the body
+    int calls;    // running now
+    int replaced; // freed when the last of its calls returns
+    func *next;
+};
+
+static func *funcs_table[FUNC_BUCKETS];
+int func_depth = 0, func_return = 0;
+
+static unsigned _hash(const char *name) {
+    unsigned h = 2166136261u;
+    for (; *name; name++) {
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    }
+    return h % FUNC_BUCKETS;
+}
+
+static func **_slot(const char *name) { // where name is, or where it would be added
+    func **f = &funcs_table[_hash(name)];
+    while (*f != NULL && strcmp((*f)->name, name) != 0) {
+        f = &(*f)->next;
+    }
+    return f;
+}
+
+static void _release(func *f) {
+    if (f->replaced && f->calls == 0) {
+        arena_free(&f->a);
+        free(f->name);
+        free(f);
+    }
+}
+
+void func_define(const char *name, node *body) { // body is copied, the caller's arena may go
+    func **slot = _slot(name), *old = *slot, *f = malloc(sizeof(func));
+    f->name = strdup(name);
+    arena_init(&f->a);
+    f->body = ast_copy(body, &f->a);
+    f->calls = f->replaced = 0;
+    f->next = (old != NULL ? old->next : NULL);
+    *slot = f;
+    if (old != NULL) {
+        old->replaced = 1;
+        _release(old);
+    }
+}
+
+int func_exists(const char *name) {
+    return *_slot(name) != NULL;
+}
+
+int func_call(char **argv) { // the status of the body, run by the shell itself
+    func *f = *_slot(argv[0]);
+    if (func_depth >= FUNC_DEPTH_MAX) {
+        out_error("%s: %s\n", argv[0], FUNC_TOO_DEEP);
+        return EXIT_FAILURE;
+    }
+    char **caller = vars_swapParams(argv + 1);
+    int final = run_final, depth = loop_depth;
+    run_final = 0;  // the caller may still have commands after this call
+    loop_depth = 0; // break and continue do not reach the caller's loops
+    f->calls++, func_depth++;
+    last_status = EXEC_SUCCESS;
+    ast_run(f->body);
+    f->calls--, func_depth--;
+    func_return = 0;
+    run_final = final, loop_depth = depth;
+    vars_swapParams(caller);
+    _release(f);
+    return last_status;
+}
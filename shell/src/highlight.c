@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtins.h"
+#include "config.h"
+#include "expand.h"
+#include "func.h"
+#include "highlight.h"
+#include "my_utils.h"
+#include "vars.h"
+
+enum { HL_ARG, HL_COMMAND, HL_UNKNOWN, HL_KEYWORD, HL_OPERATOR, HL_REDIR, HL_COMMENT };
+
+// what the next word is: a command, an argument, or the target of a redirection before either
+enum { ST_CMD, ST_ARG, ST_CMD_TARGET, ST_ARG_TARGET };
+
+typedef struct {
+    int start, len;
+    unsigned char type, state, after; // the state the token was lexed in and the one it leaves
+} _token;
+
+static _token tokens[MAX_LINE_LENGTH + 1];
+static int ntokens = 0;
+
+static const char *colors[] = {
+    [HL_COMMAND] = ANSI_COLOR_GREEN, [HL_UNKNOWN] = ANSI_COLOR_RED,  [HL_KEYWORD] = ANSI_COLOR_GOLD,
+    [HL_OPERATOR] = ANSI_COLOR_CYAN, [HL_REDIR] = ANSI_COLOR_CYAN,   [HL_COMMENT] = ANSI_COLOR_GRAY,
+};
+
+static const char *keywords[] = {"if", "then", "elif", "else", "fi", "while", "for", "do", "done", "{", "}", NULL};
+
+/* memoized command lookups, forgotten at every new prompt so new programs show up */
+
+typedef struct _known _known;
+
+struct _known {
+    char *name;
+    int exists;
+    _known *next;
+};
+
+static _known *known[HIGHLIGHT_BUCKETS];
+
+static unsigned _hash(const char *name, int len) {
+    unsigned h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return h % HIGHLIGHT_BUCKETS;
+}
+
+static int _commandExists(const char *word, int len) {
+    unsigned h = _hash(word, len);
+    for (_known *k = known[h]; k != NULL; k = k->next) {
+        if (strncmp(k->name, word, len) == 0 && k->name[len] == '\0') {
+            return k->exists;
+        }
+    }
+    _known *k = malloc(sizeof(_known));
+    k->name = strndup(word, len);
+    k->exists = isBuiltin(k->name) || func_exists(k->name) || isExecutable(k->name);
+    k->next = known[h];
+    known[h] = k;
+    return k->exists;
+}
+
+void highlight_newLine() {
+    for (int i = 0; i < HIGHLIGHT_BUCKETS; i++) {
+        while (known[i] != NULL) {
+            _known *next = known[i]->next;
+            free(known[i]->name);
+            free(known[i]);
+            known[i] = next;
+        }
+    }
+    ntokens = 0;
+}
+
+/* lexing */
+
+static int _isSpace(char c) {
+    return c == ' ' || c == '\t';
+}
+
+static int _wordEnd(const char *buf, int len, int p) { // $(...) and the groups after |> may hold spaces and operators
+    int depth = (buf[p] == '(');
+    for (p += depth; p < len; p++) {
+        if ((buf[p] == '$' || buf[p] == '<' || buf[p] == '>') && p + 1 < len && buf[p + 1] == '(') {
+            depth++;
+            p++;
+        } else if (depth > 0 && buf[p] == ')') {
+            depth--;
+        } else if (depth == 0 && strchr(LEXER_SPECIAL, buf[p]) != NULL) {
+            break;
+        }
+    }
+    return p;
+}
+
+static int _redirLen(const char *buf, int len, int p) { // [digits](< | > | >> | <> | >&), 0 if there is none
+    int q = p;
+    while (q < len && '0' <= buf[q] && buf[q] <= '9') {
+        q++;
+    }
+    if (q == len || (buf[q] != '<' && buf[q] != '>') || (q + 1 < len && buf[q + 1] == '(')) { // <(...) is a word
+        return 0;
+    }
+    q++;
+    if (q < len && (buf[q] == '>' || buf[q] == '&') && buf[q - 1] == '>') {
+        q++;
+    } else if (q < len && buf[q] == '>' && buf[q - 1] == '<') {
+        q++;
+    }
+    return q - p;
+}
+
+static int _isKeyword(const char *word, int len) {
+    for (int k = 0; keywords[k] != NULL; k++) {
+        if ((int)strlen(keywords[k]) == len && strncmp(word, keywords[k], len) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int _lexToken(const char *buf, int len, int p, int state, _token *t) { // p is at the token, returns the next state
+    t->start = p;
+    t->state = state;
+    int redir = _redirLen(buf, len, p);
+    if (buf[p] == '#') {
+        t->len = len - p, t->type = HL_COMMENT;
+        return state;
+    }
+    if (redir > 0) {
+        t->len = redir, t->type = HL_REDIR;
+        return state == ST_CMD || state == ST_CMD_TARGET ? ST_CMD_TARGET : ST_ARG_TARGET;
+    }
+    if (buf[p] == '|' && p + 1 < len && buf[p + 1] == '>') { // what follows "|>" are groups, not commands
+        t->len = 2, t->type = HL_OPERATOR;
+        return ST_ARG;
+    }
+    if (buf[p] == '|' || buf[p] == ';' || buf[p] == '&') {
+        t->len = 1, t->type = HL_OPERATOR;
+        return ST_CMD;
+    }
+    t->len = _wordEnd(buf, len, p) - p;
+    t->type = HL_ARG;
+    const char *word = buf + p;
+    switch (state) {
+        case ST_CMD_TARGET:
+            return ST_CMD;
+        case ST_ARG_TARGET:
+        case ST_ARG:
+            return ST_ARG;
+    }
+    int name = vars_assignment(word);
+    if (name > 0 && name < t->len) { // name=value before the command
+        return ST_CMD;
+    }
+    if (t->len > 2 && strncmp(word + t->len - 2, "()", 2) == 0 && vars_isName(word, t->len - 2)) { // being defined
+        t->type = HL_COMMAND;
+        return ST_CMD;
+    }
+    if (_isKeyword(word, t->len)) {
+        t->type = HL_KEYWORD;
+        return t->len == 3 && strncmp(word, "for", 3) == 0 ? ST_ARG : ST_CMD;
+    }
+    if (memchr(word, '$', t->len) == NULL) { // nothing to say about what a variable holds
+        t->type = _commandExists(word, t->len) ? HL_COMMAND : HL_UNKNOWN;
+    }
+    return ST_ARG;
+}
+
+static int _skipSpace(const char *buf, int len, int p) {
+    while (p < len && _isSpace(buf[p])) {
+        p++;
+    }
+    return p;
+}
+
+static void _lexFrom(const char *buf, int len, int first, int p, int state, _token *old, int nold, int delta) {
+    // old holds the tokens after the edit at their old positions, lexing stops once one of them lines up
+    int n = first, k = 0;
+    while ((p = _skipSpace(buf, len, p)) < len) {
+        while (k < nold && old[k].start + delta < p) {
+            k++;
+        }
+        if (k < nold && old[k].start + delta == p && old[k].state == state) {
+            for (; k < nold; k++, n++) {
+                tokens[n] = old[k];
+                tokens[n].start += delta;
+            }
+            break;
+        }
+        state = tokens[n].after = _lexToken(buf, len, p, state, &tokens[n]);
+        p += tokens[n++].len;
+    }
+    ntokens = n;
+}
+
+void highlight_set(const char *buf, int len) { // the whole line changed
+    _lexFrom(buf, len, 0, 0, ST_CMD, NULL, 0, 0);
+}
+
+void highlight_edit(const char *buf, int len, int pos, int removed, int inserted) { // buf is already edited
+    int first = 0;
+    while (first < ntokens && tokens[first].start + tokens[first].len < pos) {
+        first++;
+    }
+    while (first > 0 && first < ntokens && tokens[first - 1].start + tokens[first - 1].len == tokens[first].start) {
+        first--; // "a>" then "(" makes "a>(" one word
+    }
+    int rest = first; // tokens from here on start after the edit and are kept if lexing reaches them unchanged
+    while (rest < ntokens && tokens[rest].start < pos + removed) {
+        rest++;
+    }
+    int nold = ntokens - rest;
+    _token old[nold > 0 ? nold : 1];
+    memcpy(old, tokens + rest, nold * sizeof(_token));
+    int p = (first < ntokens ? min(tokens[first].start, pos) : pos);
+    int state = (first > 0 ? tokens[first - 1].after : ST_CMD);
+    _lexFrom(buf, len, first, p, state, old, nold, inserted - removed);
+}
+
+void highlight_print(const char *buf, int len) {
+    int p = 0;
+    for (int i = 0; i < ntokens; i++) {
+        fwrite(buf + p, 1, tokens[i].start - p, stdout);
+        const char *color = colors[tokens[i].type];
+        if (color != NULL) {
+            printf("%s%.*s%s", color, tokens[i].len, buf + tokens[i].start, ANSI_COLOR_RESET);
+        } else {
+            fwrite(buf + tokens[i].start, 1, tokens[i].len, stdout);
+        }
+        p = tokens[i].start + tokens[i].len;
+    }
+    fwrite(buf + p, 1, len - p, stdout);
+}
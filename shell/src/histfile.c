@@ -0,0 +1,146 @@
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "histfile.h"
+
+#define HISTFILE_MAGIC "MSHHIST"
+#define HISTFILE_VERSION 1
+#define HISTFILE_HEADER 4096 // keeps the ring page aligned
+#define RECORD_ALIGN 16
+
+typedef struct {
+    char magic[8];
+    uint32_t version, size;
+    _Atomic uint64_t head; // bytes ever reserved, records live at head % size
+} _header;
+
+typedef struct {
+    _Atomic uint64_t stamp; // 1 + the record's absolute offset once it is complete
+    uint32_t len;
+    uint32_t pid; // 0 for padding up to the end of the ring
+} _record;
+
+static _header *hdr = NULL;
+static char *ring;
+static uint64_t read_pos = 0, stuck_pos = UINT64_MAX;
+static int synced = 0;
+
+static uint32_t _recordSize(uint32_t len) {
+    return (sizeof(_record) + len + RECORD_ALIGN - 1) & ~(uint32_t)(RECORD_ALIGN - 1);
+}
+
+static _record *_at(uint64_t pos) {
+    return (_record *)(ring + pos % SHARED_HISTORY_SIZE);
+}
+
+int histfile_open(const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        return 0;
+    }
+    off_t len = HISTFILE_HEADER + SHARED_HISTORY_SIZE;
+    if ((st.st_size < len && ftruncate(fd, len) < 0) || st.st_size > len) {
+        close(fd);
+        return 0;
+    }
+    void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    _header *h = map;
+    if (h->magic[0] == '\0') { // new file; sessions racing here all write the same bytes
+        h->version = HISTFILE_VERSION;
+        h->size = SHARED_HISTORY_SIZE;
+        memcpy(h->magic, HISTFILE_MAGIC, sizeof(h->magic));
+    }
+    if (memcmp(h->magic, HISTFILE_MAGIC, sizeof(h->magic)) != 0 || h->version != HISTFILE_VERSION
+        || h->size != SHARED_HISTORY_SIZE) {
+        munmap(map, len);
+        return 0;
+    }
+    hdr = h;
+    ring = (char *)map + HISTFILE_HEADER;
+    return 1;
+}
+
+void histfile_append(const char *entry, int len) {
+    if (hdr == NULL || len > MAX_LINE_LENGTH) {
+        return;
+    }
+    uint32_t size = _recordSize(len);
+    while (1) {
+        uint64_t pos = atomic_fetch_add(&hdr->head, size);
+        _record *r = _at(pos);
+        if (pos % SHARED_HISTORY_SIZE + size <= SHARED_HISTORY_SIZE) {
+            memcpy(r + 1, entry, len);
+            r->len = len;
+            r->pid = getpid();
+            atomic_store_explicit(&r->stamp, pos + 1, memory_order_release);
+            return;
+        }
+        r->len = size - sizeof(_record); // records never wrap, this one only tells readers to skip
+        r->pid = 0;
+        atomic_store_explicit(&r->stamp, pos + 1, memory_order_release);
+    }
+}
+
+static uint64_t _resync(uint64_t from, uint64_t head) { // first complete record at or after from
+    uint64_t pos = (from + RECORD_ALIGN - 1) & ~(uint64_t)(RECORD_ALIGN - 1);
+    for (; pos < head; pos += RECORD_ALIGN) {
+        if (atomic_load_explicit(&_at(pos)->stamp, memory_order_acquire) == pos + 1) {
+            break; // record text never holds the zero bytes of a stamp, so this is a header
+        }
+    }
+    return pos;
+}
+
+void histfile_read(void (*add)(const char *, int)) { // calls add for every entry other sessions completed since the last call
+    if (hdr == NULL) {
+        return;
+    }
+    uint64_t head = atomic_load_explicit(&hdr->head, memory_order_acquire);
+    if (!synced || head > read_pos + SHARED_HISTORY_SIZE) { // at start, or fell a whole lap behind
+        read_pos = _resync(head > SHARED_HISTORY_SIZE ? head - SHARED_HISTORY_SIZE : 0, head);
+        synced = 1;
+    }
+    char entry[MAX_LINE_LENGTH + 1];
+    while (read_pos < head) {
+        _record *r = _at(read_pos);
+        if (atomic_load_explicit(&r->stamp, memory_order_acquire) != read_pos + 1) {
+            if (stuck_pos != read_pos) { // most likely being written right now, look again next time
+                stuck_pos = read_pos;
+                return;
+            }
+            read_pos = _resync(read_pos + RECORD_ALIGN, head); // its writer died before finishing
+            continue;
+        }
+        uint32_t len = r->len, pid = r->pid;
+        if (len > SHARED_HISTORY_SIZE - sizeof(_record) || (pid != 0 && len > MAX_LINE_LENGTH)) {
+            read_pos = _resync(read_pos + RECORD_ALIGN, head);
+            continue;
+        }
+        if (pid != 0) {
+            memcpy(entry, r + 1, len);
+        }
+        uint64_t now = atomic_load_explicit(&hdr->head, memory_order_acquire);
+        if (now > read_pos + SHARED_HISTORY_SIZE) { // a later reservation reused it while it was copied
+            head = now;
+            read_pos = _resync(head - SHARED_HISTORY_SIZE, head);
+            continue;
+        }
+        if (pid != 0 && pid != (uint32_t)getpid()) {
+            entry[len] = '\0';
+            add(entry, len);
+        }
+        read_pos += _recordSize(len);
+    }
+}
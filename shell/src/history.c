@@ -1,17 +1,67 @@
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "config.h"
+#include "histfile.h"
 #include "history.h"
 #include "my_utils.h"
+#include "out.h"
 
 char **history;
 int insert_pos, return_pos, cur_size;
 
+/*
+ * Prefix index for suggestions: a trie over the entries where every node remembers the
+ * newest entry that continues past it. Children are a sibling list, at most one per
+ * printable character, so both adding and looking up cost the length of the text.
+ */
+
+typedef struct {
+    char c;
+    int newest;         // entry index, -1 while only entries ending here passed by
+    int child, sibling; // node indices, 0 for none (the root is nobody's child)
+} _trie_node;
+
+_trie_node *trie;
+int trie_len, trie_size;
+
+static int _trieChild(int node, char c, int create) { // 0 if there is none and create is not set
+    int child = trie[node].child;
+    while (child != 0 && trie[child].c != c) {
+        child = trie[child].sibling;
+    }
+    if (child != 0 || !create) {
+        return child;
+    }
+    if (trie_len == trie_size) {
+        trie_size *= 2;
+        trie = realloc(trie, trie_size * sizeof(_trie_node));
+    }
+    trie[trie_len] = (_trie_node){.c = c, .newest = -1, .child = 0, .sibling = trie[node].child};
+    trie[node].child = trie_len;
+    return trie_len++;
+}
+
+static void _trieAdd(const char *entry, int len, int index) {
+    int node = 0;
+    for (int i = 0; i < len; i++) {
+        trie[node].newest = index;
+        node = _trieChild(node, entry[i], 1);
+    }
+}
+
 void history_init() {
     history = malloc(HISTORY_STARTSIZE * sizeof(char *));
     cur_size = HISTORY_STARTSIZE;
     insert_pos = 0, return_pos = 0;
+    trie = malloc(HISTORY_STARTSIZE * sizeof(_trie_node));
+    trie_size = HISTORY_STARTSIZE, trie_len = 1;
+    trie[0] = (_trie_node){.c = '\0', .newest = -1, .child = 0, .sibling = 0};
+    char *shared = getenv(SHARED_HISTORY_ENV);
+    if (shared != NULL && shared[0] != '\0' && !histfile_open(shared)) {
+        out_error("%s: %s\n", shared, SHARED_HISTORY_FAIL);
+    }
 }
 
 static void _history_resize() {
@@ -22,16 +72,55 @@ static void _history_resize() {
     cur_size *= 2;
 }
 
-void history_add(char *cmd, int len) {
+static int _append(const char *cmd, int len) { // the new entry's index, -1 for an empty line
     if (len == 0) {
-        return;
+        return -1;
     }
     if (insert_pos == cur_size) {
         _history_resize();
     }
     history[insert_pos] = malloc((len + 1) * sizeof(char));
     memcpy(history[insert_pos], cmd, (len + 1) * sizeof(char));
-    insert_pos++;
+    return insert_pos++;
+}
+
+static void _addLocal(const char *cmd, int len) { // a command that was run, here or in another session
+    int index = _append(cmd, len);
+    if (index >= 0) {
+        _trieAdd(cmd, len, index);
+    }
+}
+
+void history_add(char *cmd, int len) { // a command that was entered, other sessions see it too
+    _addLocal(cmd, len);
+    if (len > 0) {
+        histfile_append(cmd, len);
+    }
+}
+
+void history_addDraft(char *cmd, int len) { // the unfinished line, kept while browsing but never suggested
+    _append(cmd, len);
+}
+
+void history_sync() { // picks up what other sessions entered
+    int reset = history_isPtrReset();
+    histfile_read(_addLocal);
+    if (reset) {
+        history_resetPtr();
+    }
+}
+
+char *history_suggest(const char *prefix, int len) { // the newest entry longer than prefix that starts with it
+    if (len == 0) {
+        return NULL;
+    }
+    int node = 0;
+    for (int i = 0; i < len; i++) {
+        if ((node = _trieChild(node, prefix[i], 0)) == 0) {
+            return NULL;
+        }
+    }
+    return trie[node].newest >= 0 ? history[trie[node].newest] : NULL;
 }
 
 void history_arrowUp() {
@@ -0,0 +1,360 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <linux/magic.h>
+#include <linux/sched.h>
+
+#include "config.h"
+#include "job.h"
+#include "my_utils.h"
+#include "out.h"
+
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+
+job_settings *job_current = NULL;
+static job_stats stats = {.jobs = 0, .maxrss = 0, .maxrss_pid = 0};
+static int in_cgroup = 0; // the child was cloned straight into the cgroup
+
+int job_parseCpus(const char *list, cpu_set_t *set) { // "0-3,6"
+    CPU_ZERO(set);
+    const char *p = list;
+    while (1) {
+        char *end;
+        long from = strtol(p, &end, 10), to = from;
+        if (end == p || from < 0) {
+            return 0;
+        }
+        if (*end == '-') {
+            p = end + 1;
+            to = strtol(p, &end, 10);
+            if (end == p || to < from) {
+                return 0;
+            }
+        }
+        if (to >= CPU_SETSIZE) {
+            return 0;
+        }
+        for (long cpu = from; cpu <= to; cpu++) {
+            CPU_SET(cpu, set);
+        }
+        if (*end == '\0') {
+            return 1;
+        }
+        if (*end != ',') {
+            return 0;
+        }
+        p = end + 1;
+    }
+}
+
+int job_parseIoprio(const char *str, int *ioprio) { // CLASS[:LEVEL], CLASS is rt, be, idle or 1-3
+    static const char *classes[] = {"", "rt", "be", "idle", NULL};
+    const char *colon = strchr(str, ':');
+    int len = (colon != NULL ? colon - str : (int)strlen(str)), cls = 0;
+    for (int i = 1; classes[i] != NULL; i++) {
+        if ((int)strlen(classes[i]) == len && strncmp(str, classes[i], len) == 0) {
+            cls = i;
+        }
+    }
+    if (len == 1 && '1' <= str[0] && str[0] <= '3') {
+        cls = str[0] - '0';
+    }
+    long level = 0;
+    if (cls == 0 || (colon != NULL && (!myAtoi(colon + 1, &level) || level < 0 || level > 7))) {
+        return 0;
+    }
+    *ioprio = cls << IOPRIO_CLASS_SHIFT | level;
+    return 1;
+}
+
+static int _isCgroup2(int fd) { // ENOTSUP if it is not
+    struct statfs fs;
+    if (fstatfs(fd, &fs) == 0 && fs.f_type == CGROUP2_SUPER_MAGIC) {
+        return 1;
+    }
+    errno = ENOTSUP;
+    return 0;
+}
+
+static int _leavesDir(const char *path) { // a ".." component could lead out of the hierarchy
+    for (const char *p = path; (p = strstr(p, "..")) != NULL; p += 2) {
+        if ((p == path || p[-1] == '/') && (p[2] == '\0' || p[2] == '/')) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int job_openCgroup(const char *path, const char *mem) { // creates the directory if needed, -1 on failure
+    char full[PATH_MAX];
+    struct statfs root;
+    int len;
+    if (statfs(CGROUP_ROOT, &root) < 0 || root.f_type != CGROUP2_SUPER_MAGIC || _leavesDir(path)) { // no directories made elsewhere
+        errno = ENOTSUP;
+        return -1;
+    }
+    if (strncmp(path, CGROUP_ROOT "/", strlen(CGROUP_ROOT) + 1) == 0) {
+        len = snprintf(full, sizeof(full), "%s", path);
+    } else {
+        len = snprintf(full, sizeof(full), "%s/%s", CGROUP_ROOT, path + (path[0] == '/'));
+    }
+    if (len < 0 || len >= (int)sizeof(full)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    mkdir(full, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+    int fd = open(full, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0 && !_isCgroup2(fd)) { // a link or a mount inside the hierarchy
+        close(fd);
+        errno = ENOTSUP;
+        return -1;
+    }
+    if (fd < 0 || mem == NULL) {
+        return fd;
+    }
+    int max_fd = openat(fd, "memory.max", O_WRONLY | O_CLOEXEC);
+    if (max_fd < 0 || write(max_fd, mem, strlen(mem)) < 0) {
+        int saved_errno = errno;
+        if (max_fd >= 0) {
+            close(max_fd);
+        }
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+    close(max_fd);
+    return fd;
+}
+
+int job_parseDuration(const char *str, struct timespec *ts) { // seconds with an optional fraction and s, m, h or d after
+    char *end;
+    errno = 0;
+    double secs = strtod(str, &end);
+    const char *units = "smhd";
+    static const int scale[] = {1, 60, 3600, 86400};
+    if (*end != '\0' && (end[1] != '\0' || strchr(units, *end) == NULL)) {
+        return 0;
+    }
+    secs *= (*end != '\0' ? scale[strchr(units, *end) - units] : 1);
+    if (errno != 0 || end == str || secs < 0 || secs > (double)LONG_MAX / 2) {
+        return 0;
+    }
+    ts->tv_sec = (time_t)secs;
+    ts->tv_nsec = (long)((secs - ts->tv_sec) * 1e9);
+    return 1;
+}
+
+int job_parseSignal(const char *str, int *sig) { // TERM, SIGTERM or 15
+    long num;
+    if (myAtoi(str, &num)) {
+        *sig = num;
+        return num > 0 && num < NSIG;
+    }
+    if (strncmp(str, "SIG", 3) == 0) {
+        str += 3;
+    }
+    for (int i = 1; i < NSIG; i++) {
+        const char *name = sigabbrev_np(i);
+        if (name != NULL && strcmp(name, str) == 0) {
+            *sig = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int _terminalForeground() { // the shell's group is the foreground one of its controlling terminal
+    int fd = open("/dev/tty", O_RDONLY | O_NOCTTY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    int fg = (tcgetpgrp(fd) == getpgrp());
+    close(fd);
+    return fg;
+}
+
+int job_arm(job_deadline *d, const struct timespec *after) { // 0 if no timer could be had
+    if (d->timer_fd < 0) { // only the first time, KILL_AFTER re-arms it
+        d->own_group = !_terminalForeground();
+        d->owner = getpid();
+    }
+    struct itimerspec when = {.it_value = *after};
+    if (when.it_value.tv_sec == 0 && when.it_value.tv_nsec == 0) { // a zero timer would be disarmed
+        when.it_value.tv_nsec = 1;
+    }
+    if (d->timer_fd < 0 && (d->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)) < 0) {
+        return 0;
+    }
+    return timerfd_settime(d->timer_fd, 0, &when, NULL) == 0;
+}
+
+void job_disarm(job_deadline *d) {
+    if (d->timer_fd >= 0) {
+        close(d->timer_fd);
+    }
+    free(d->pids);
+}
+
+pid_t job_fork() { // fork, or clone3 straight into the job's cgroup
+    if (job_current == NULL || job_current->cgroup_fd < 0) {
+        return fork();
+    }
+    struct clone_args args = {.flags = CLONE_INTO_CGROUP, .exit_signal = SIGCHLD, .cgroup = job_current->cgroup_fd};
+    pid_t pid = syscall(SYS_clone3, &args, sizeof(args));
+    if (pid == 0) {
+        in_cgroup = 1;
+    }
+    if (pid < 0) { // an older kernel or a cgroup that refuses it, the child tries to join by itself and fails alone
+        pid = fork();
+    }
+    return pid;
+}
+
+static void _record(job_deadline *d, pid_t pid) {
+    if (d->pids_len == d->pids_size) {
+        d->pids_size = (d->pids_size == 0 ? 8 : 2 * d->pids_size);
+        d->pids = realloc(d->pids, d->pids_size * sizeof(pid_t));
+    }
+    d->pids[d->pids_len++] = pid;
+}
+
+void job_newPipeline() { // a group of its own for each pipeline, the adopted processes stay
+    job_deadline *d = (job_current != NULL ? job_current->deadline : NULL);
+    if (d != NULL && d->owner == getpid()) { // a forked copy of the shell keeps its pipeline's group
+        d->group = 0, d->pids_len = d->adopted;
+    }
+}
+
+void job_adopt(job_deadline *d, pid_t pid) { // signalled along with every pipeline under the deadline
+    _record(d, pid);
+    d->adopted = d->pids_len;
+}
+
+void job_group(pid_t pid) { // both sides of the fork call it, whichever runs first creates the group
+    job_deadline *d = (job_current != NULL ? job_current->deadline : NULL);
+    if (d == NULL) {
+        return;
+    }
+    if (!d->own_group) { // a group in the background would get SIGTTIN and miss ^C
+        if (pid != 0) {
+            _record(d, pid);
+        }
+        return;
+    }
+    setpgid(pid, d->group); // 0 for the first process makes it the leader
+    if (d->group == 0) { // a child that is a copy of the shell puts its own children there too
+        d->group = (pid != 0 ? pid : getpid());
+    }
+}
+
+int job_timerFd() { // -1 when nothing has to be watched
+    job_deadline *d = (job_current != NULL ? job_current->deadline : NULL);
+    return d != NULL && d->owner == getpid() ? d->timer_fd : -1; // a forked copy of the shell must not take the tick
+}
+
+static void _signal(job_deadline *d, int sig) { // the whole pipeline
+    if (d->group > 0) {
+        kill(-d->group, sig);
+    }
+    for (int i = 0; i < d->pids_len; i++) {
+        kill(d->pids[i], sig);
+    }
+}
+
+void job_expired() { // the timer fired: the signal first, KILL once kill_after has passed as well
+    job_deadline *d = job_current->deadline;
+    uint64_t ticks;
+    if (read(d->timer_fd, &ticks, sizeof(ticks)) != sizeof(ticks)) {
+        return;
+    }
+    int sig = (d->expired == 0 ? d->signal : SIGKILL);
+    _signal(d, sig);
+    if (sig != SIGKILL && sig != SIGCONT) { // a stopped process would never see it
+        _signal(d, SIGCONT);
+    }
+    d->expired++;
+    if (d->expired == 1 && (d->kill_after.tv_sec != 0 || d->kill_after.tv_nsec != 0)) {
+        job_arm(d, &d->kill_after);
+    }
+}
+
+static void _fail(const char *what) {
+    out_error("%s: %s\n", what, JOB_SETTINGS_FAIL);
+    exit(EXEC_FAILURE);
+}
+
+void job_apply() { // in the child, before exec
+    job_settings *s = job_current;
+    if (s == NULL) {
+        return;
+    }
+    if (s->cgroup_fd >= 0 && !in_cgroup) {
+        int fd = openat(s->cgroup_fd, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+        if (fd < 0 || write(fd, "0", 1) < 0) {
+            _fail("cgroup");
+        }
+        close(fd);
+    }
+    if (s->has_cpus && sched_setaffinity(0, sizeof(cpu_set_t), &s->cpus) < 0) {
+        _fail("cpus");
+    }
+    if (s->has_nice && setpriority(PRIO_PROCESS, 0, s->nice) < 0) {
+        _fail("nice");
+    }
+    if (s->ioprio >= 0 && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, s->ioprio) < 0) {
+        _fail("ioprio");
+    }
+}
+
+static struct timeval _elapsed(const struct timespec *start, const struct timespec *end) {
+    long long ns = (end->tv_sec - start->tv_sec) * 1000000000LL + (end->tv_nsec - start->tv_nsec);
+    return (struct timeval){.tv_sec = ns / 1000000000, .tv_usec = ns % 1000000000 / 1000};
+}
+
+static double _seconds(struct timeval tv) {
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+void job_account(pid_t pid, const struct timespec *start, const struct timespec *end, const struct rusage *ru) {
+    struct timeval real = _elapsed(start, end);
+    timeradd(&stats.real, &real, &stats.real);
+    timeradd(&stats.user, &ru->ru_utime, &stats.user);
+    timeradd(&stats.sys, &ru->ru_stime, &stats.sys);
+    if (ru->ru_maxrss > stats.maxrss) {
+        stats.maxrss = ru->ru_maxrss;
+        stats.maxrss_pid = pid;
+    }
+    stats.jobs++;
+}
+
+void job_printUsage(const struct timespec *start, const struct timespec *end, const struct rusage *ru) { // for the completion notice
+    struct timeval cpu;
+    timeradd(&ru->ru_utime, &ru->ru_stime, &cpu);
+    out_printf("[real %.2fs, cpu %.2fs, maxrss %ld KiB]", _seconds(_elapsed(start, end)), _seconds(cpu), ru->ru_maxrss);
+}
+
+void job_printStats() {
+    out_printf("jobs\t%ld\n", stats.jobs);
+    out_printf("real\t%.3fs\n", _seconds(stats.real));
+    out_printf("user\t%.3fs\n", _seconds(stats.user));
+    out_printf("sys\t%.3fs\n", _seconds(stats.sys));
+    if (stats.maxrss_pid != 0) {
+        out_printf("maxrss\t%ld KiB (pid %d)\n", stats.maxrss, stats.maxrss_pid);
+    } else {
+        out_printf("maxrss\t0 KiB\n");
+    }
+}
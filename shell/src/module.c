@@ -0,0 +1,118 @@
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtins.h"
+#include "config.h"
+#include "module.h"
+#include "mshell_module.h"
+#include "out.h"
+#include "vars.h"
+
+typedef struct loaded loaded;
+
+struct loaded {
+    builtin_pair b;
+    char *path;
+    loaded *next;
+};
+
+static loaded *modules_table[MODULE_BUCKETS];
+
+static const mshell_host host = {
+    .abi = MSHELL_MODULE_ABI,
+    .write = out_write,
+    .getvar = vars_get,
+    .setvar = vars_set,
+};
+
+static unsigned _hash(const char *name) {
+    unsigned h = 2166136261u;
+    for (; *name; name++) {
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    }
+    return h % MODULE_BUCKETS;
+}
+
+static loaded **_slot(const char *name) { // where name is, or where it would be added
+    loaded **l = &modules_table[_hash(name)];
+    while (*l != NULL && strcmp((*l)->b.name, name) != 0) {
+        l = &(*l)->next;
+    }
+    return l;
+}
+
+builtin_pair *module_find(const char *name) {
+    loaded *l = *_slot(name);
+    return l != NULL ? &l->b : NULL;
+}
+
+static const mshell_module_info *_open(const char *path) { // handles stay open, dlopen counts repeated loads
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        out_error("%s\n", dlerror());
+        return NULL;
+    }
+    const mshell_module_info *info = dlsym(handle, MSHELL_MODULE_SYMBOL);
+    if (info == NULL || info->abi != MSHELL_MODULE_ABI || info->builtins == NULL) {
+        out_error("%s: %s\n", path, MODULE_ABI_MISMATCH);
+        dlclose(handle);
+        return NULL;
+    }
+    if (info->init != NULL && info->init(&host) != 0) {
+        dlclose(handle);
+        return NULL;
+    }
+    return info;
+}
+
+int module_load(const char *path, char **names) { // 0 if anything failed, the names found are enabled anyway
+    const mshell_module_info *info = _open(path);
+    if (info == NULL) {
+        return 0;
+    }
+    int ok = 1;
+    for (; *names != NULL; names++) {
+        const mshell_builtin *mb = info->builtins;
+        while (mb->name != NULL && strcmp(mb->name, *names) != 0) {
+            mb++;
+        }
+        if (mb->name == NULL) {
+            out_error("%s: %s\n", *names, MODULE_NO_BUILTIN);
+            ok = 0;
+            continue;
+        }
+        loaded **slot = _slot(mb->name), *l = *slot;
+        if (l == NULL) {
+            l = *slot = malloc(sizeof(loaded));
+            l->b.name = strdup(mb->name);
+            l->next = NULL;
+        } else {
+            free(l->path);
+        }
+        l->b.fun = mb->fun;
+        l->path = strdup(path);
+    }
+    return ok;
+}
+
+int module_unload(const char *name) {
+    loaded **slot = _slot(name), *l = *slot;
+    if (l == NULL) {
+        return 0;
+    }
+    *slot = l->next;
+    free(l->b.name);
+    free(l->path);
+    free(l);
+    return 1;
+}
+
+void module_list() {
+    for (int i = 0; i < MODULE_BUCKETS; i++) {
+        for (loaded *l = modules_table[i]; l != NULL; l = l->next) {
+            out_printf("%s\t%s\n", l->b.name, l->path);
+        }
+    }
+}
@@ -1,24 +1,54 @@
 #include <signal.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/wait.h>
 
+#include "arena.h"
+#include "ast.h"
+#include "cache.h"
 #include "config.h"
 #include "my_utils.h"
+#include "out.h"
 #include "prompt.h"
 #include "read.h"
 #include "run.h"
+#include "serve.h"
 #include "siparse.h"
+#include "vars.h"
 
 int main(int argc, char *argv[]) {
     prepareEverything();
+    if (argc > 1 && strcmp(argv[1], "-c") == 0) { // mshell -c 'cmdline' [name [args...]], for make and job runners
+        if (argc == 2) {
+            out_error("%s\n", MISSING_COMMAND);
+            return SYNTAX_STATUS;
+        }
+        if (argc > 3) {
+            vars_setArgs(argv + 3);
+        }
+        cache_runString(argv[2]);
+    }
+    if (argc > 1 && strcmp(argv[1], "--serve") == 0) { // mshell --serve SOCKET [-j N]
+        long max = SERVE_WORKERS;
+        if (argc != 3 && (argc != 5 || strcmp(argv[3], "-j") != 0 || !myAtoi(argv[4], &max) || max < 1)) {
+            out_error("%s\n", SERVE_USAGE);
+            return SYNTAX_STATUS;
+        }
+        serve_run(argv[2], max);
+    }
+    if (argc > 1) { // mshell script [args...]
+        vars_setArgs(argv + 1);
+        cache_runScript(argv[1]);
+    }
+    prepareInteractive();
+    arena line_arena;
+    arena_init(&line_arena);
     while (1) {
         prompt_print();
-        pipelineseq *ln = read_newLine();
-        if (ln == NULL) {
-            fprintf(stderr, "%s\n", SYNTAX_ERROR_STR);
-            continue;
-        }
-        run_pipelineseq(ln);
+        char *line = read_newLine();
+        arena_reset(&line_arena);
+        node *n = ast_parse(line, read_moreLine, NULL, &line_arena);
+        ast_runInput(n, !is_a_tty && read_atEof());
     }
     return EXEC_SUCCESS;
 }
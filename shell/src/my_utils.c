@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -12,7 +13,9 @@
 #include "builtins.h"
 #include "config.h"
 #include "history.h"
+#include "job.h"
 #include "my_utils.h"
+#include "out.h"
 #include "prompt.h"
 #include "read.h"
 #include "run.h"
@@ -26,17 +29,6 @@ int max(int a, int b) {
     return a > b ? a : b;
 }
 
-void prepareArgsArray(char **arr, const command *com) {
-    argseq *argseq = com->args;
-    int i = 0;
-    do {
-        arr[i] = argseq->arg;
-        argseq = argseq->next;
-        i++;
-    } while (argseq != com->args);
-    arr[i] = NULL;
-}
-
 int myAtoi(const char *str, long *v) {
     char *endptr;
     errno = 0;
@@ -49,73 +41,90 @@ int myAtoi(const char *str, long *v) {
 
 void printError(char *filename, int print_execerror) {
     if (errno == ENOENT) {
-        fprintf(stderr, "%s: %s", filename, WRONG_FILE);
+        out_error("%s: %s", filename, WRONG_FILE);
     } else if (errno == EACCES) {
-        fprintf(stderr, "%s: %s", filename, NO_PERMISSIONS);
+        out_error("%s: %s", filename, NO_PERMISSIONS);
     } else if (print_execerror) {
-        fprintf(stderr, "%s: %s", filename, EXEC_ERROR);
+        out_error("%s: %s", filename, EXEC_ERROR);
     }
-    fprintf(stderr, "\n");
+    out_error("\n");
 }
 
-int redirectIn(char *filename) {
-    int in = open(filename, O_RDONLY);
-    if (in < 0) {
-        printError(filename, 0);
-        return 0;
+int openRedirs(redir_op *op) { // in the shell, so the child only has to dup2
+    for (redir_op *it = op; it != NULL; it = it->next) {
+        int flags = O_CLOEXEC;
+        switch (it->mode) {
+            case REDIR_DUP:
+            case REDIR_KEEP: // opened already
+                continue;
+            case REDIR_READ:
+                flags |= O_RDONLY;
+                break;
+            case REDIR_WRITE:
+                flags |= O_WRONLY | O_CREAT | O_TRUNC;
+                break;
+            case REDIR_APPEND:
+                flags |= O_WRONLY | O_CREAT | O_APPEND;
+                break;
+            case REDIR_RDWR:
+                flags |= O_RDWR | O_CREAT;
+                break;
+        }
+        int fd = open(it->target, flags, S_IRUSR | S_IWUSR);
+        if (fd >= 0 && fd < REDIR_FD_MIN) { // out of the way of the descriptors being redirected
+            int high = fcntl(fd, F_DUPFD_CLOEXEC, REDIR_FD_MIN);
+            close(fd);
+            fd = high;
+        }
+        if (fd < 0) {
+            printError(it->target, 0);
+            closeRedirs(op);
+            return 0;
+        }
+        it->src = fd;
     }
-    dup2(in, STDIN_FILENO);
-    close(in);
     return 1;
 }
 
-int redirectOut(char *filename, int append) {
-    int out = open(filename, O_WRONLY | (append ? O_APPEND : O_TRUNC) | O_CREAT, S_IRUSR | S_IWUSR);
-    if (out < 0) {
-        printError(filename, 0);
-        return 0;
+void closeRedirs(redir_op *op) {
+    for (; op != NULL; op = op->next) {
+        if (op->src >= 0) {
+            close(op->src);
+            op->src = -1;
+        }
     }
-    dup2(out, STDOUT_FILENO);
-    close(out);
-    return 1;
 }
 
-int processRedirs(command *com) {
-    redirseq *redirs = com->redirs;
-    if (redirs != NULL) {
-        do {
-            int flags = redirs->r->flags;
-            char *filename = redirs->r->filename;
-            if (IS_RIN(flags) && !redirectIn(filename)) {
-                return 0;
-            } else if (IS_ROUT(flags) && !redirectOut(filename, 0)) {
-                return 0;
-            } else if (IS_RAPPEND(flags) && !redirectOut(filename, 1)) {
+int applyRedirs(redir_op *op) { // in the child, in order; the opened files are closed by exec
+    for (; op != NULL; op = op->next) {
+        int src = op->src;
+        if (op->mode == REDIR_DUP && op->target[0] == '-') {
+            close(op->fd);
+            continue;
+        }
+        if (op->mode == REDIR_DUP) {
+            src = atoi(op->target);
+        }
+        if (src == op->fd) {
+            if (fcntl(src, F_SETFD, 0) < 0) {
+                out_error("%s: %s\n", op->target, BAD_FD);
                 return 0;
             }
-            redirs = redirs->next;
-        } while (redirs != com->redirs);
+        } else if (dup2(src, op->fd) < 0) {
+            out_error("%s: %s\n", op->target, BAD_FD);
+            return 0;
+        }
     }
     return 1;
 }
 
 int isBuiltin(char *name) {
-    int i = 0;
-    while (builtins_table[i].name != NULL && strcmp(builtins_table[i].name, name) != 0) {
-        i++;
-    }
-    return builtins_table[i].name != NULL;
+    return builtins_find(name) != NULL;
 }
 
 int callBuiltin(char *name, char **args) {
-    int i = 0;
-    while (builtins_table[i].name != NULL && strcmp(builtins_table[i].name, name) != 0) {
-        i++;
-    }
-    if (builtins_table[i].name != NULL) {
-        return builtins_table[i].fun(args);
-    }
-    return -1;
+    builtin_pair *b = builtins_find(name);
+    return b != NULL ? b->fun(args) : -1;
 }
 
 int getNullPos(char **args) {
@@ -131,11 +140,15 @@ typedef struct pid_pair pid_pair;
 struct pid_pair {
     pid_t pid;
     int status;
+    int tag; // 0 for plain '&' jobs, otherwise the job belongs to whoever set the tag (lpar)
+    struct timespec start, end;
+    struct rusage usage;
     pid_pair *prev;
     pid_pair *next;
 };
 
 pid_pair *bgjobs_head = NULL, *bgjobs_tail = NULL;
+int bgjob_tag = 0, last_bgjob_tag = 0;
 
 void _init_bgjobs() {
     if (bgjobs_head == NULL) {
@@ -152,16 +165,20 @@ void newBgjob(pid_t pid) {
     pid_pair *new = malloc(sizeof(pid_pair));
     new->pid = pid;
     new->status = -1;
+    new->tag = bgjob_tag;
+    clock_gettime(CLOCK_MONOTONIC, &new->start);
     new->prev = bgjobs_tail;
     new->next = NULL;
     bgjobs_tail->next = new;
     bgjobs_tail = new;
 }
 
-int bgjobFinished(pid_t pid, int rstat) {
+int bgjobFinished(pid_t pid, int rstat, const struct rusage *usage) { // called from the SIGCHLD handler
     pid_pair *cur = bgjobs_head->next;
     while (cur != NULL) {
         if (cur->pid == pid) {
+            clock_gettime(CLOCK_MONOTONIC, &cur->end);
+            cur->usage = *usage;
             cur->status = rstat;
             return 1;
         }
@@ -170,6 +187,57 @@ int bgjobFinished(pid_t pid, int rstat) {
     return 0;
 }
 
+int newBgjobTag() {
+    return ++last_bgjob_tag;
+}
+
+int setBgjobTag(int tag) {
+    int old = bgjob_tag;
+    bgjob_tag = tag;
+    return old;
+}
+
+int countBgjobs(int tag) {
+    int cnt = 0;
+    for (pid_pair *cur = bgjobs_head->next; cur != NULL; cur = cur->next) {
+        if (cur->tag == tag && cur->pid != -1) { // not the placeholder
+            cnt++;
+        }
+    }
+    return cnt;
+}
+
+static void _removeBgjob(pid_pair *tmp) { // only finished jobs are removed
+    job_account(tmp->pid, &tmp->start, &tmp->end, &tmp->usage);
+    if (tmp->prev != NULL) {
+        tmp->prev->next = tmp->next;
+    } else {
+        bgjobs_head = tmp->next;
+    }
+    if (tmp->next != NULL) {
+        tmp->next->prev = tmp->prev;
+    } else {
+        bgjobs_tail = tmp->prev;
+    }
+    free(tmp);
+}
+
+pid_t takeFinishedBgjob(int tag_from, int *tag, int *status, struct rusage *usage) { // call with SIGCHLD blocked, usage may be NULL
+    for (pid_pair *cur = bgjobs_head->next; cur != NULL; cur = cur->next) {
+        if (cur->tag >= tag_from && cur->status != -1) {
+            pid_t pid = cur->pid;
+            *tag = cur->tag;
+            *status = cur->status;
+            if (usage != NULL) {
+                *usage = cur->usage;
+            }
+            _removeBgjob(cur);
+            return pid;
+        }
+    }
+    return 0;
+}
+
 sigset_t sigchldMask, EMPTY_SIGSET;
 
 void blockSigchld() {
@@ -189,52 +257,68 @@ void restoreSigactions() {
     sigaction(SIGCHLD, &old_sigchld, NULL);
 }
 
+static void _setSigactions(struct sigaction *save_sigint, struct sigaction *save_sigchld) {
+    sigaction(SIGINT, &(struct sigaction){.sa_handler = SIG_IGN, .sa_mask = EMPTY_SIGSET}, save_sigint);
+    sigaction(SIGCHLD, &(struct sigaction){.sa_handler = run_sigchldHandler, .sa_flags = SA_RESTART | SA_NOCLDSTOP, .sa_mask = EMPTY_SIGSET}, save_sigchld);
+}
+
+void resumeSigactions() { // undoes restoreSigactions, e.g. after a failed exec
+    _setSigactions(NULL, NULL);
+    blockSigchld();
+}
+
+void resumeSigchld() { // for a copy of the shell that waits for children of its own, ^C still stops it
+    struct sigaction sigint;
+    sigaction(SIGINT, NULL, &sigint);
+    _setSigactions(NULL, NULL);
+    sigaction(SIGINT, &sigint, NULL);
+    blockSigchld();
+}
+
 void prepareEverything() {
     sigemptyset(&EMPTY_SIGSET);
-    sigaction(SIGINT, &(struct sigaction){.sa_handler = SIG_IGN, .sa_mask = EMPTY_SIGSET}, &old_sigint);
-    sigaction(SIGCHLD, &(struct sigaction){.sa_handler = run_sigchldHandler, .sa_flags = SA_RESTART | SA_NOCLDSTOP, .sa_mask = EMPTY_SIGSET}, &old_sigchld);
+    _setSigactions(&old_sigint, &old_sigchld);
 
     sigemptyset(&sigchldMask);
     sigaddset(&sigchldMask, SIGCHLD);
 
     atexit(restoreSigactions);
 
-    saveTerm();
-    atexit(restoreTerm);
-    prompt_init();
-    history_init();
+    atexit(out_flush);
 
     newBgjob(-1); // so the list is never empty
 
     ENV_PATH = getenv("PATH");
 }
 
+void prepareInteractive() { // only for the prompt loop, scripts and -c never pay for it
+    is_a_tty = isatty(STDIN_FILENO);
+    if (!is_a_tty) {
+        return;
+    }
+    saveTerm();
+    atexit(restoreTerm);
+    history_init();
+}
+
 void processDeadChildren() {
     pid_pair *cur = bgjobs_head->next;
     while (cur != NULL) {
-        if (cur->status != -1) {
+        if (cur->status != -1 && cur->tag == 0) {
             if (is_a_tty) {
-                printf("Background process %d ", cur->pid);
+                out_printf("Background process %d ", cur->pid);
                 if (WIFEXITED(cur->status)) {
-                    printf("terminated. (exited with status %d)", WEXITSTATUS(cur->status));
+                    out_printf("terminated. (exited with status %d)", WEXITSTATUS(cur->status));
                 } else {
-                    printf("terminated. (killed by signal %d)", WTERMSIG(cur->status));
+                    out_printf("terminated. (killed by signal %d)", WTERMSIG(cur->status));
                 }
-                printf("\n");
+                out_write(" ", 1);
+                job_printUsage(&cur->start, &cur->end, &cur->usage);
+                out_write("\n", 1);
             }
             pid_pair *tmp = cur;
             cur = cur->next;
-            if (tmp->prev != NULL) {
-                tmp->prev->next = tmp->next;
-            } else {
-                bgjobs_head = tmp->next;
-            }
-            if (tmp->next != NULL) {
-                tmp->next->prev = tmp->prev;
-            } else {
-                bgjobs_tail = tmp->prev;
-            }
-            free(tmp);
+            _removeBgjob(tmp);
         } else {
             cur = cur->next;
         }
@@ -245,10 +329,6 @@ int _isExecutable(char *real_path) {
     return access(real_path, F_OK | X_OK) == 0;
 }
 
-int isReadable(char *fn) {
-    return access(fn, F_OK | R_OK) == 0;
-}
-
 char full_path[PATH_MAX];
 int isExecutable(char *fn) {
     if (_isExecutable(fn)) {
@@ -0,0 +1,145 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "my_utils.h"
+#include "out.h"
+
+static char buffer[OUT_BUF_MAX + 1]; // room for vsnprintf's terminating NUL
+static size_t used = 0, limit = 0;   // limit is 0 until stdout has been looked at
+static int line_mode = 0;
+static out_sink *sink = NULL; // set while a builtin's output is being captured
+
+static void _size() { // a pipe takes its whole capacity in one write, files like whole blocks
+    struct stat st;
+    long size = OUT_BUF_MAX;
+    line_mode = isatty(STDOUT_FILENO);
+    if (fstat(STDOUT_FILENO, &st) == 0) {
+        if (S_ISFIFO(st.st_mode)) {
+            size = fcntl(STDOUT_FILENO, F_GETPIPE_SZ);
+        } else if (S_ISREG(st.st_mode)) {
+            size = st.st_blksize * OUT_FILE_BLOCKS;
+        } else {
+            size = st.st_blksize;
+        }
+    }
+    limit = (size <= 0 ? OUT_BUF_MAX : min(max(size, MAX_LINE_LENGTH), OUT_BUF_MAX));
+}
+
+static void _writeAll(const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(STDOUT_FILENO, data, len);
+        if (written > 0) {
+            data += written, len -= written;
+        } else if (written < 0 && errno == EAGAIN) { // somebody left stdout non-blocking
+            poll(&(struct pollfd){.fd = STDOUT_FILENO, .events = POLLOUT}, 1, -1);
+        } else if (written < 0 && errno != EINTR) {
+            return; // nobody to tell, stderr may be gone as well
+        }
+    }
+}
+
+static void _sinkAppend(const char *data, size_t len) {
+    if (sink->len + len + 1 > sink->size) {
+        sink->size = max(2 * sink->size, sink->len + len + 1);
+        sink->data = realloc(sink->data, sink->size);
+    }
+    memcpy(sink->data + sink->len, data, len);
+    sink->len += len;
+}
+
+void out_flush() {
+    if (sink == NULL && used > 0) {
+        _writeAll(buffer, used);
+        used = 0;
+    }
+}
+
+void out_write(const char *data, size_t len) {
+    if (sink != NULL) {
+        _sinkAppend(data, len);
+        return;
+    }
+    if (limit == 0) {
+        _size();
+    }
+    if (used + len > limit) {
+        out_flush();
+    }
+    if (len >= limit) {
+        _writeAll(data, len);
+        return;
+    }
+    memcpy(buffer + used, data, len);
+    used += len;
+    if (line_mode && memchr(data, '\n', len) != NULL) {
+        out_flush();
+    }
+}
+
+void out_puts(const char *str) {
+    out_write(str, strlen(str));
+}
+
+void out_printf(const char *fmt, ...) {
+    va_list ap;
+    if (sink == NULL && limit == 0) {
+        _size();
+    }
+    if (sink == NULL) { // straight into the buffer when it fits
+        va_start(ap, fmt);
+        int len = vsnprintf(buffer + used, limit - used + 1, fmt, ap);
+        va_end(ap);
+        if (len >= 0 && (size_t)len <= limit - used) {
+            used += len;
+            if (line_mode && memchr(buffer + used - len, '\n', len) != NULL) {
+                out_flush();
+            }
+            return;
+        }
+    }
+    char *str;
+    va_start(ap, fmt);
+    int len = vasprintf(&str, fmt, ap);
+    va_end(ap);
+    if (len < 0) {
+        out_error("%s\n", ALLOC_FAIL);
+        exit(EXEC_FAILURE);
+    }
+    out_write(str, len);
+    free(str);
+}
+
+void out_error(const char *fmt, ...) { // stderr, after what builtins wrote before it
+    va_list ap;
+    int saved = errno;
+    out_flush();
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    errno = saved;
+}
+
+void out_retarget() { // stdout was redirected, what is buffered belongs to the old target
+    out_flush();
+    limit = 0;
+}
+
+int out_direct() { // 1 if a builtin may write to descriptor 1 itself, the buffer is empty then
+    out_flush();
+    return sink == NULL;
+}
+
+out_sink *out_capture(out_sink *new) { // NULL goes back to stdout, returns the previous sink
+    out_flush();
+    out_sink *old = sink;
+    sink = new;
+    return old;
+}
@@ -0,0 +1,92 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "config.h"
+#include "expand.h"
+#include "parse.h"
+#include "siparse.h"
+
+/*
+ * parseline() hands out structures from a static pool which the next call overwrites.
+ * Everything that may parse again before it is done with a line (builtins running other
+ * command lines, nested substitutions...) works on a copy living in an arena instead.
+ */
+
+static argseq *_copyArgs(argseq *args, arena *a) {
+    argseq *head = NULL, *it = args;
+    do {
+        argseq *new = ARENA_NEW(a, argseq);
+        new->arg = arena_strdup(a, it->arg);
+        LIST_APPEND(head, new);
+        it = it->next;
+    } while (it != args);
+    return head;
+}
+
+static redirseq *_copyRedirs(redirseq *redirs, arena *a) {
+    if (redirs == NULL) {
+        return NULL;
+    }
+    redirseq *head = NULL, *it = redirs;
+    do {
+        redirseq *new = ARENA_NEW(a, redirseq);
+        new->r = ARENA_NEW(a, redir);
+        new->r->filename = arena_strdup(a, it->r->filename);
+        new->r->flags = it->r->flags;
+        LIST_APPEND(head, new);
+        it = it->next;
+    } while (it != redirs);
+    return head;
+}
+
+static command *_copyCommand(command *com, arena *a) {
+    if (com == NULL) {
+        return NULL;
+    }
+    command *new = ARENA_NEW(a, command);
+    new->args = _copyArgs(com->args, a);
+    new->redirs = _copyRedirs(com->redirs, a);
+    return new;
+}
+
+static pipeline *_copyPipeline(pipeline *p, arena *a) {
+    pipeline *new_p = ARENA_NEW(a, pipeline);
+    commandseq *head = NULL, *it = p->commands;
+    do {
+        commandseq *new = ARENA_NEW(a, commandseq);
+        new->com = _copyCommand(it->com, a);
+        LIST_APPEND(head, new);
+        it = it->next;
+    } while (it != p->commands);
+    new_p->commands = head;
+    new_p->flags = p->flags;
+    return new_p;
+}
+
+pipelineseq *parse_copy(pipelineseq *ln, arena *a) {
+    if (ln == NULL) {
+        return NULL;
+    }
+    pipelineseq *head = NULL, *it = ln;
+    do {
+        pipelineseq *new = ARENA_NEW(a, pipelineseq);
+        new->pipeline = _copyPipeline(it->pipeline, a);
+        LIST_APPEND(head, new);
+        it = it->next;
+    } while (it != ln);
+    return head;
+}
+
+pipelineseq *parse_line(char *str, arena *a) {
+    if (!expand_needsPreparing(str)) {
+        return parse_copy(parseline(str), a);
+    }
+    char line[MAX_LINE_LENGTH + 1];
+    if (!expand_prepareLine(str, line, sizeof(line))) {
+        errno = YYERRORFLAG;
+        return NULL;
+    }
+    return parse_copy(parseline(line), a);
+}
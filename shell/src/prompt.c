@@ -6,6 +6,7 @@
 
 #include "config.h"
 #include "my_utils.h"
+#include "out.h"
 #include "prompt.h"
 
 const char *PROMPT_STR_C = (char *)PROMPT_STR;
@@ -14,15 +15,14 @@ struct passwd *pwd;
 char cwd[PATH_MAX];
 char *home_dir;
 int home_dir_len;
-int is_a_tty, cwd_flag;
+int is_a_tty = 0, cwd_flag, identity_loaded = 0;
 
 static void _die() {
-    fprintf(stderr, "%s\n", PROMPT_ERROR);
+    out_error("%s\n", PROMPT_ERROR);
     exit(EXEC_FAILURE);
 }
 
-void prompt_init() {
-    is_a_tty = isatty(STDIN_FILENO);
+static void _loadIdentity() { // on the first prompt, getpwuid may have to load NSS modules
     if (gethostname(hostname, HOST_NAME_MAX) != 0) {
         _die();
     }
@@ -36,6 +36,7 @@ void prompt_init() {
         _die();
     }
     home_dir_len = strlen(home_dir);
+    identity_loaded = 1;
 }
 
 void changeCwd() {
@@ -47,6 +48,10 @@ void prompt_print() {
     if (is_a_tty == 0) {
         return;
     }
+    out_flush(); // the prompt goes through stdio
+    if (!identity_loaded) {
+        _loadIdentity();
+    }
     if (cwd_flag) {
         if (getcwd(cwd, sizeof(cwd)) == NULL) {
             _die();
@@ -1,15 +1,22 @@
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
 #include <termios.h>
 #include <unistd.h>
 
 #include "config.h"
+#include "highlight.h"
 #include "history.h"
 #include "my_utils.h"
+#include "out.h"
 #include "prompt.h"
 #include "read.h"
+#include "run.h"
 #include "siparse.h"
 
 int buf_beg = 0, buf_end = -1;
@@ -17,13 +24,118 @@ char buf[BUF_MAX + 1];
 int seen_eof = 0;
 const int oo = MAX_LINE_LENGTH + 3;
 
+enum { INPUT_UNKNOWN, INPUT_SEEKABLE, INPUT_PIPE, INPUT_SOCKET, INPUT_OTHER };
+static int input_kind = INPUT_UNKNOWN;
+static int peek_pipe[2];        // stdin is tee'd in here to look ahead without taking anything
+static size_t peeked = 0;       // bytes at the end of what a pipe or a socket gave that are still in it
+static off_t released_at = -1; // where a seekable stdin was handed to children, -1 if it was not
+static dev_t input_dev;
+static ino_t input_ino; // a builtin may run with another file on fd 0
+
+static int _inputKind() {
+    struct stat st = {.st_mode = 0}; // neither a pipe nor a socket if fstat fails
+    if (input_kind != INPUT_UNKNOWN) {
+        return input_kind;
+    }
+    fstat(STDIN_FILENO, &st);
+    input_dev = st.st_dev, input_ino = st.st_ino;
+    if (S_ISFIFO(st.st_mode) && pipe2(peek_pipe, O_CLOEXEC) == 0) {
+        for (int i = 0; i < 2; i++) { // out of the way of numbered redirections
+            int high = fcntl(peek_pipe[i], F_DUPFD_CLOEXEC, REDIR_FD_MIN);
+            close(peek_pipe[i]);
+            peek_pipe[i] = high;
+        }
+        input_kind = INPUT_PIPE;
+    } else if (S_ISSOCK(st.st_mode)) {
+        input_kind = INPUT_SOCKET;
+    } else if (lseek(STDIN_FILENO, 0, SEEK_CUR) >= 0) {
+        input_kind = INPUT_SEEKABLE;
+    } else {
+        input_kind = INPUT_OTHER;
+    }
+    return input_kind;
+}
+
+static ssize_t _peek(char *dst, size_t len) { // what a read would get without taking it, -1 if stdin cannot tell
+    ssize_t got = -1;
+    if (_inputKind() == INPUT_SOCKET) {
+        got = recv(STDIN_FILENO, dst, len, MSG_PEEK);
+    } else if (input_kind == INPUT_PIPE && (got = tee(STDIN_FILENO, peek_pipe[1], len, 0)) > 0) {
+        got = read(peek_pipe[0], dst, got);
+    } else if (input_kind == INPUT_PIPE && got < 0 && errno == EINVAL) { // not a pipe after all
+        input_kind = INPUT_OTHER;
+    }
+    return got;
+}
+
+static void _take(size_t len) { // drops len bytes that were peeked at from stdin
+    static char scratch[BUF_MAX];
+    while (len > 0) {
+        ssize_t got = read(STDIN_FILENO, scratch, min(len, sizeof(scratch)));
+        if (got <= 0 && errno != EINTR) {
+            break;
+        }
+        len -= max(got, 0);
+    }
+    peeked = 0;
+}
+
+static ssize_t _readInput(char *dst, size_t len) { // in bulk, a pipe or a socket leaves it in stdin until a child needs it
+    if (_inputKind() == INPUT_SEEKABLE || input_kind == INPUT_OTHER) {
+        return read(STDIN_FILENO, dst, len);
+    }
+    _take(peeked); // whatever is still in the buffer is kept there
+    ssize_t got = _peek(dst, len);
+    if (input_kind == INPUT_OTHER) {
+        return read(STDIN_FILENO, dst, len);
+    }
+    peeked = max(got, 0);
+    return got;
+}
+
+void read_release() { // before a child may read stdin, it goes back to the end of the lines read
+    struct stat st;
+    if (is_a_tty || _inputKind() == INPUT_OTHER) {
+        return;
+    }
+    if (fstat(STDIN_FILENO, &st) < 0 || st.st_dev != input_dev || st.st_ino != input_ino) {
+        return;
+    }
+    int ahead = (buf_beg <= buf_end ? buf_end - buf_beg + 1 : 0);
+    if (input_kind == INPUT_SEEKABLE) {
+        if (released_at < 0 && ahead > 0) {
+            released_at = lseek(STDIN_FILENO, -(off_t)ahead, SEEK_CUR);
+        }
+        return;
+    }
+    if (peeked == 0 || peeked < (size_t)ahead) { // nothing taken yet, or the lines ahead began before the last peek
+        return;
+    }
+    _take(peeked - ahead); // the rest stays in the pipe and is peeked at again
+    buf_beg = 0, buf_end = -1;
+    seen_eof = seen_eof && ahead == 0;
+}
+
+static void _reclaim() { // the lines read ahead are still good unless a child moved the offset
+    if (released_at < 0) {
+        return;
+    }
+    if (lseek(STDIN_FILENO, 0, SEEK_CUR) == released_at) {
+        lseek(STDIN_FILENO, buf_end - buf_beg + 1, SEEK_CUR);
+    } else {
+        buf_beg = 0, buf_end = -1;
+        seen_eof = 0;
+    }
+    released_at = -1;
+}
+
 static void _fillBuffer() {
     if (seen_eof) {
         return;
     }
     if (buf_end + 1 != BUF_MAX) {
         errno = 0;
-        int bytes_read = read(STDIN_FILENO, buf + buf_end + 1, BUF_MAX - buf_end - 1);
+        int bytes_read = _readInput(buf + buf_end + 1, BUF_MAX - buf_end - 1);
         if (errno == EAGAIN) { // pajp
             _fillBuffer();     // or maybe goto?
             return;
@@ -31,7 +143,7 @@ static void _fillBuffer() {
         if (bytes_read == 0) {
             seen_eof = 1;
         } else if (bytes_read < 0) {
-            fprintf(stderr, "%s\n", READ_FAIL);
+            out_error("%s\n", READ_FAIL);
             exit(EXEC_FAILURE);
         }
         buf_end += bytes_read;
@@ -72,7 +184,7 @@ static void _smartRead(int printedSyntaxError) {
                            : newline_it - buf);
     if (newline_pos - buf_beg >= MAX_LINE_LENGTH) {
         if (!printedSyntaxError) {
-            fprintf(stderr, "%s\n", SYNTAX_ERROR_STR);
+            out_error("%s\n", SYNTAX_ERROR_STR);
         }
         _tryToSkip();
     } else if (newline_it != NULL && newline_pos <= buf_end) {
@@ -110,10 +222,10 @@ static void _enableRawMode() {
     tcsetattr(STDIN_FILENO, TCSANOW, &raw);
 }
 
-static pipelineseq *_parseline(char *bbuf) {
+static char *_lineRead(char *line) {
     blockSigchld();
     restoreTerm();
-    return parseline(bbuf);
+    return line;
 }
 
 static char _my_getchar() {
@@ -124,7 +236,7 @@ static char _my_getchar() {
         return _my_getchar();
     }
     if (bytes_read < 0) {
-        fprintf(stderr, "%s\n", READ_FAIL);
+        out_error("%s\n", READ_FAIL);
         exit(EXEC_FAILURE);
     }
     return c;
@@ -152,53 +264,77 @@ void _go_right(char *buf, int *index) {
     *index = i;
 }
 
-pipelineseq *read_newLine() {
-    unblockSigchld();
-    if (!is_a_tty) {
-        _smartRead(0);
-        if (cmd_from > cmd_to) {
-            exit(EXEC_SUCCESS);
+char *read_scriptLine() {
+    _reclaim();
+    _smartRead(0);
+    if (cmd_from > cmd_to) {
+        if (is_a_tty) { // ^D only ends this read, the editor keeps the terminal
+            seen_eof = 0;
+            buf_beg = 0, buf_end = -1;
         }
-        buf[cmd_to] = '\0';
-        return _parseline(buf + cmd_from);
+        return NULL;
     }
+    buf[cmd_to] = '\0';
+    return buf + cmd_from;
+}
 
+static char *_readTty(const char *prompt, int continuation) {
+    out_flush();
     _enableRawMode();
     int index = 0, buf_len = 0;
     buf[0] = '\0';
-    printf("%s", PROMPT_STR_2);
+    printf("%s", prompt);
     fflush(stdout);
+    history_sync();
     history_resetPtr();
+    if (!continuation) {
+        highlight_newLine();
+    }
+    highlight_set(buf, 0);
     while (1) {
-        char c;
+        char c, *suggestion;
         if ((c = _my_getchar()) == EOT && buf_len == 0) {
+            if (continuation) {
+                printf("\n");
+                return _lineRead(NULL);
+            }
             exit(EXIT_SUCCESS);
-        } else if (c == CTRL_C && buf_len != 0) {
+        } else if (c == CTRL_C && (buf_len != 0 || continuation)) {
             if (buf_len - index > 0) {
                 printf("\033[%dC", buf_len - index);
             }
-            printf("^C\n");
-            return _parseline("");
-        } else if (c == CTRL_Q) {
-            return _parseline("asciiquarium");
+            printf("\033[0K^C\n"); // over a suggestion, if one is shown
+            return _lineRead(continuation ? NULL : "");
+        } else if (c == CTRL_Q && !continuation) {
+            return _lineRead("asciiquarium");
         } else if (PRINTABLE_START <= c && c <= PRINTABLE_END && buf_len < MAX_LINE_LENGTH) {
             memmove(buf + index + 1, buf + index, buf_len - index + 1);
-            buf[index++] = c;
+            buf[index] = c;
             buf_len++;
+            highlight_edit(buf, buf_len, index++, 0, 1);
         } else if (c == EOL) {
+            if (index == buf_len && history_suggest(buf, buf_len) != NULL) {
+                printf("\033[0K"); // the suggestion was not taken
+            }
             printf("\033[%dD\n", oo);
 
             history_add(buf, buf_len);
-            return _parseline(buf);
+            return _lineRead(buf);
         } else if (c == ESCAPE) {
             if ((c = _my_getchar()) == ARROW_BLOCK_START) {
                 if ((c = _my_getchar()) == ARROW_LEFT) {
                     index = max(0, index - 1);
+                } else if (c == ARROW_RIGHT && index == buf_len && (suggestion = history_suggest(buf, buf_len)) != NULL) {
+                    strcpy(buf, suggestion); // accepting the suggestion
+                    buf_len = strlen(buf);
+                    index = buf_len;
+                    highlight_set(buf, buf_len);
                 } else if (c == ARROW_RIGHT) {
                     index = min(buf_len, index + 1);
                 } else if (c == ARROW_UP || c == ARROW_DOWN) {
+                    history_sync();
                     if (history_isPtrReset()) {
-                        history_add(buf, buf_len);
+                        history_addDraft(buf, buf_len);
                     }
                     (c == ARROW_UP ? history_arrowUp() : history_arrowDown());
                     char *old_command;
@@ -206,6 +342,7 @@ pipelineseq *read_newLine() {
                         strcpy(buf, old_command);
                         buf_len = strlen(buf);
                         index = buf_len;
+                        highlight_set(buf, buf_len);
                     }
                 } else if (c == 49 && _my_getchar() == 59 && _my_getchar() == 53) { // magic for handling the ctrl + left/right
                     if ((c = _my_getchar()) == ARROW_LEFT) {
@@ -219,16 +356,56 @@ pipelineseq *read_newLine() {
             memmove(buf + index - 1, buf + index, buf_len - index + 1);
             index--;
             buf_len--;
+            highlight_edit(buf, buf_len, index, 1, 0);
         } else {
             continue;
         }
         printf("\033[%dD", oo);
         printf("\033[0K");
-        printf("%s", PROMPT_STR_2);
-        printf("%s", buf);
-        if (buf_len - index > 0) {
-            printf("\033[%dD", buf_len - index);
+        printf("%s", prompt);
+        highlight_print(buf, buf_len);
+        int shown = 0; // the rest of a suggestion, after the cursor
+        if (index == buf_len && (suggestion = history_suggest(buf, buf_len)) != NULL) {
+            shown = strlen(suggestion) - buf_len;
+            printf("%s%s%s", ANSI_DIM, suggestion + buf_len, ANSI_COLOR_RESET);
+        }
+        if (buf_len - index + shown > 0) {
+            printf("\033[%dD", buf_len - index + shown);
         }
         fflush(stdout);
     }
 }
+
+char *read_newLine() {
+    unblockSigchld();
+    if (!is_a_tty) {
+        char *line = read_scriptLine();
+        if (line == NULL) {
+            exit(last_status);
+        }
+        return _lineRead(line);
+    }
+    return _readTty(PROMPT_STR_2, 0);
+}
+
+int read_atEof() { // script input: 1 if nothing follows the lines read so far, never blocks on a live writer
+    _reclaim();
+    if (buf_beg <= buf_end) {
+        return 0;
+    }
+    struct pollfd in = {.fd = STDIN_FILENO, .events = POLLIN};
+    _take(peeked); // or they would make a pipe look ready
+    if (!seen_eof && poll(&in, 1, 0) > 0) { // ready, so either data or the EOF
+        buf_beg = 0, buf_end = -1;
+        _fillBuffer();
+    }
+    return seen_eof && buf_beg > buf_end;
+}
+
+char *read_moreLine(void *ctx) { // continuation of an unfinished block, NULL at EOF
+    (void)ctx;
+    if (!is_a_tty) {
+        return read_scriptLine();
+    }
+    return _readTty(PROMPT_STR_CONT, 1);
+}
@@ -0,0 +1,206 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "out.h"
+#include "relay.h"
+
+static ssize_t _splice(int from, int to, size_t len) {
+    ssize_t moved;
+    do {
+        moved = splice(from, NULL, to, NULL, len, SPLICE_F_MOVE);
+    } while (moved < 0 && errno == EINTR);
+    return moved;
+}
+
+static void _discard(int from, ssize_t len) { // for a consumer that is gone, its share still has to leave the pipe
+    char sink[PIPE_BUF];
+    ssize_t got;
+    while (len > 0 && (got = read(from, sink, len < PIPE_BUF ? len : PIPE_BUF)) != 0) {
+        if (got < 0 && errno != EINTR) {
+            return;
+        }
+        len -= (got > 0 ? got : 0);
+    }
+}
+
+static void _deliver(int from, int *to, ssize_t len, int *alive) { // exactly len bytes, the output is closed if its reader left
+    while (len > 0 && *to >= 0) {
+        ssize_t moved = _splice(from, *to, len);
+        if (moved <= 0) {
+            close(*to);
+            *to = -1;
+            (*alive)--;
+            break;
+        }
+        len -= moved;
+    }
+    _discard(from, len);
+}
+
+int relay_run(int in, int *outs, int n) { // the exit status, outputs that stop reading are dropped
+    signal(SIGPIPE, SIG_IGN);
+    int size = fcntl(in, F_GETPIPE_SZ), alive = n;
+    int copy[n][2]; // copy[i] holds the chunk for outs[i], the last output takes the chunk from the input itself
+    for (int i = 0; i < n - 1; i++) {
+        if (pipe(copy[i]) < 0 || fcntl(copy[i][1], F_SETPIPE_SZ, size) < size) {
+            out_error("%s\n", PIPE_FAIL);
+            return EXEC_FAILURE;
+        }
+    }
+    while (alive > 0) {
+        ssize_t len = (n == 1 ? size : 0);
+        for (int i = 0; i < n - 1; i++) {
+            // an empty copy pipe as big as the input takes all that tee finds, so every copy gets the same len bytes
+            ssize_t copied;
+            do {
+                copied = tee(in, copy[i][1], i == 0 ? INT_MAX : len, 0);
+            } while (copied < 0 && errno == EINTR);
+            if (copied < 0 || (i > 0 && copied != len)) {
+                out_error("%s\n", RELAY_FAIL);
+                return EXEC_FAILURE;
+            }
+            if (copied == 0) {
+                return EXEC_SUCCESS;
+            }
+            len = copied;
+        }
+        if (n == 1) { // nothing to duplicate
+            ssize_t moved = _splice(in, outs[0], len);
+            if (moved <= 0) {
+                return moved == 0 || errno == EPIPE ? EXEC_SUCCESS : EXEC_FAILURE;
+            }
+            continue;
+        }
+        _deliver(in, &outs[n - 1], len, &alive);
+        for (int i = 0; i < n - 1; i++) {
+            _deliver(copy[i][0], &outs[i], len, &alive);
+        }
+    }
+    return EXEC_SUCCESS;
+}
+
+enum { COPY_RANGE, COPY_SPLICE, COPY_SENDFILE, COPY_READ };
+
+static int _copyMethod(int in, int out) { // the best the descriptors allow, a refusal falls back further
+    struct stat si, so;
+    if (fstat(in, &si) < 0 || fstat(out, &so) < 0) {
+        return COPY_READ;
+    }
+    if (S_ISREG(si.st_mode) && S_ISREG(so.st_mode) && !(fcntl(out, F_GETFL) & O_APPEND)) { // no appending for copy_file_range
+        return COPY_RANGE;
+    }
+    if (S_ISFIFO(si.st_mode) || S_ISFIFO(so.st_mode)) {
+        return COPY_SPLICE;
+    }
+    return S_ISREG(si.st_mode) ? COPY_SENDFILE : COPY_READ;
+}
+
+static ssize_t _copyChunk(int method, int in, int out) {
+    switch (method) {
+        case COPY_RANGE:
+            return copy_file_range(in, NULL, out, NULL, COPY_CHUNK, 0);
+        case COPY_SPLICE:
+            return splice(in, NULL, out, NULL, COPY_CHUNK, SPLICE_F_MOVE);
+    }
+    return sendfile(out, in, NULL, COPY_CHUNK);
+}
+
+static int _writeAll(int out, const char *buf, ssize_t len) {
+    while (len > 0) {
+        ssize_t written = write(out, buf, len);
+        if (written < 0 && errno != EINTR) {
+            return 0;
+        }
+        if (written > 0) {
+            buf += written, len -= written;
+        }
+    }
+    return 1;
+}
+
+static int _readWrite(int in, int out) {
+    char *buf = malloc(COPY_BUFFER);
+    int ok = (buf != NULL);
+    ssize_t got;
+    while (ok && (got = read(in, buf, COPY_BUFFER)) != 0) {
+        ok = (got < 0 ? errno == EINTR : _writeAll(out, buf, got));
+    }
+    free(buf);
+    return ok ? 0 : -1;
+}
+
+int relay_copy(int in, int out) { // from the current offsets to the end of in, -1 with errno on failure
+    int method = _copyMethod(in, out), moved = 0;
+    while (method != COPY_READ) {
+        ssize_t len = _copyChunk(method, in, out);
+        if (len > 0) {
+            moved = 1;
+            continue;
+        }
+        if (len < 0 && errno == EINTR) {
+            continue;
+        }
+        if (moved && len == 0) {
+            return 0;
+        }
+        if (moved || (len < 0 && errno != EINVAL && errno != EXDEV && errno != ENOSYS && errno != EOPNOTSUPP)) {
+            return -1;
+        }
+        // refused before anything moved, or 0 from a file that only claims to be empty like those in /proc
+        method = (method == COPY_RANGE ? COPY_SENDFILE : COPY_READ);
+    }
+    return _readWrite(in, out);
+}
+
+static double _now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void _report(const char *label, long long bytes, double elapsed, const double *waited, int final) {
+    double mib = bytes / (1024.0 * 1024.0), pct = (elapsed > 0 ? 100 / elapsed : 0);
+    out_error(METER_REPORT, label, mib, elapsed, (elapsed > 0 ? mib / elapsed : 0.0), waited[0] * pct, waited[1] * pct, (final ? "" : " ..."));
+}
+
+int relay_meter(int in, int out, const char *label, int live) { // the exit status, the report goes to stderr when in ends or out stops reading
+    signal(SIGPIPE, SIG_IGN);
+    struct pollfd ends[2] = {{.fd = in, .events = POLLIN}, {.fd = out, .events = POLLOUT}};
+    double start = _now(), next = start + METER_INTERVAL, waited[2] = {0, 0};
+    long long bytes = 0;
+    int ret = EXEC_SUCCESS;
+    while (1) {
+        ssize_t moved = splice(in, NULL, out, NULL, COPY_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (moved > 0) {
+            bytes += moved;
+        } else if (moved == 0) {
+            break;
+        } else if (errno == EAGAIN) { // the input is empty, or else the output is full
+            int side = (poll(&ends[0], 1, 0) > 0);
+            double t = _now();
+            poll(&ends[side], 1, live ? (int)((next > t ? next - t : 0) * 1000) + 1 : -1);
+            waited[side] += _now() - t;
+        } else if (errno != EINTR) {
+            ret = (errno == EPIPE ? EXEC_SUCCESS : EXEC_FAILURE); // the reader is gone, the writer learns it once in closes
+            break;
+        }
+        if (live && _now() >= next) {
+            _report(label, bytes, _now() - start, waited, 0);
+            next += METER_INTERVAL;
+        }
+    }
+    close(in);
+    close(out);
+    _report(label, bytes, _now() - start, waited, 1);
+    return ret;
+}
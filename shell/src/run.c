@@ -1,32 +1,47 @@
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "arena.h"
+#include "ast.h"
 #include "builtins.h"
 #include "config.h"
+#include "expand.h"
+#include "func.h"
+#include "job.h"
 #include "my_utils.h"
+#include "out.h"
+#include "parse.h"
 #include "prompt.h"
 #include "read.h"
+#include "relay.h"
 #include "run.h"
 #include "siparse.h"
-
-#define MAX_ARGS MAX_LINE_LENGTH / 2 + 1
-
-char *args[MAX_ARGS];
+#include "vars.h"
 
 pid_t last_cmd_pid;
 volatile sig_atomic_t last_cmd_status;
+int last_status = 0;
+int run_final = 0;
+static int _tail = 0; // the pipeline about to run is the last thing the shell will do
+static pid_t *substs = NULL; // the <(...) children of the pipeline running now
+static int substs_len = 0, substs_size = 0;
 volatile sig_atomic_t active_foreground = 0;
 
 void run_sigchldHandler(int sig) {
     int old_errno = errno;
     pid_t child;
     int status;
-    while ((child = waitpid(-1, &status, WNOHANG)) > 0) {
-        if (!bgjobFinished(child, status)) {
+    struct rusage usage;
+    while ((child = wait4(-1, &status, WNOHANG, &usage)) > 0) {
+        if (!bgjobFinished(child, status, &usage)) {
             active_foreground--;
             if (child == last_cmd_pid) {
                 last_cmd_status = status;
@@ -35,20 +50,108 @@ void run_sigchldHandler(int sig) {
     }
     errno = old_errno;
 }
-pid_t run_command(command *com, int in, int useless_in, int out, int bgjob, int call_builtins) {
-    if (com == NULL) {
+static int _assignVariables(char **args) { // a command made only of name=value words
+    for (int i = 0; args[i] != NULL; i++) {
+        if (!vars_assignment(args[i])) {
+            return 0;
+        }
+    }
+    for (int i = 0; args[i] != NULL; i++) {
+        int len = vars_assignment(args[i]);
+        args[i][len] = '\0';
+        vars_set(args[i], args[i] + len + 1);
+    }
+    return 1;
+}
+
+static int _callHere(char **args) { // a builtin or a function, in the shell process
+    return isBuiltin(args[0]) ? callBuiltin(args[0], args) : func_call(args);
+}
+
+static int _callBuiltin(redir_op *redirs, char **args) { // redirections are applied to the shell itself and undone after
+    if (redirs == NULL) {
+        return _callHere(args);
+    }
+    int cnt = 0, to_stdout = 0;
+    for (redir_op *op = redirs; op != NULL; op = op->next) {
+        cnt++;
+        to_stdout |= (op->fd == STDOUT_FILENO);
+    }
+    struct {
+        int fd, saved; // saved is -1 if fd was not open
+    } saves[cnt];
+    int nsaves = 0;
+    for (redir_op *op = redirs; op != NULL; op = op->next) {
+        int i = 0;
+        while (i < nsaves && saves[i].fd != op->fd) {
+            i++;
+        }
+        if (i == nsaves) {
+            saves[nsaves].fd = op->fd;
+            saves[nsaves++].saved = fcntl(op->fd, F_DUPFD_CLOEXEC, REDIR_FD_MIN);
+        }
+    }
+    int permanent = strcmp(args[0], "exec") == 0 && args[1] == NULL; // "exec >file" redirects the shell
+    int ret = BUILTIN_ERROR;
+    out_flush();
+    out_sink *sink = (to_stdout ? out_capture(NULL) : NULL); // "$(lecho x >f)" writes the file, not the capture
+    if (applyRedirs(redirs)) {
+        out_retarget();
+        ret = _callHere(args);
+    }
+    out_retarget();
+    while (nsaves--) {
+        int fd = saves[nsaves].fd, saved = saves[nsaves].saved;
+        if (permanent) {
+            close(saved);
+        } else if (saved >= 0) {
+            dup2(saved, fd);
+            close(saved);
+        } else {
+            close(fd);
+        }
+    }
+    if (to_stdout) {
+        out_capture(sink);
+    }
+    return ret;
+}
+
+static int _readsInput(redir_op *redirs) { // "< in > out" copies like cat would, "> out" alone only truncates
+    for (redir_op *op = redirs; op != NULL; op = op->next) {
+        if (op->fd == STDIN_FILENO && op->mode != REDIR_KEEP && !(op->mode == REDIR_DUP && strcmp(op->target, "-") == 0)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+pid_t run_command(redir_op *redirs, char **args, int in, int useless_in, int out, int bgjob, int call_builtins) {
+    if (args == NULL || args[0] == NULL) {
+        return 0;
+    }
+    if (call_builtins && _assignVariables(args)) {
+        last_cmd_status = 0;
         return 0;
     }
-    prepareArgsArray(args, com);
-    if (call_builtins && callBuiltin(args[0], args) != -1) {
+    // a function runs here too, unless its output is captured or it is a job of its own
+    if (call_builtins && (isBuiltin(args[0]) || (in == STDIN_FILENO && out == STDOUT_FILENO && !bgjob && func_exists(args[0])))) {
+        last_cmd_status = W_EXITCODE(_callBuiltin(redirs, args), 0);
         return 0;
     }
     pid_t child_pid;
-    if ((child_pid = fork()) == 0) {
+    out_flush(); // or the child would write it too
+    if (in == STDIN_FILENO && !_readsInput(redirs)) {
+        read_release(); // or the child would miss what the shell read ahead
+    }
+    if ((child_pid = job_fork()) == 0) {
         if (bgjob) {
             setsid();
+        } else {
+            job_group(0);
         }
         restoreSigactions();
+        job_apply();
         if (useless_in != STDIN_FILENO) {
             close(useless_in);
         }
@@ -60,10 +163,20 @@ pid_t run_command(command *com, int in, int useless_in, int out, int bgjob, int
             dup2(out, STDOUT_FILENO);
             close(out);
         }
-        if (processRedirs(com)) {
-            execvp(args[0], args);
-            printError(args[0], 1); // execvp can fail
+        if (!applyRedirs(redirs)) {
+            exit(EXEC_FAILURE);
+        }
+        if (_assignVariables(args)) { // "x=1 &" leaves the shell's variables alone
+            exit(EXEC_SUCCESS);
+        }
+        if (isBuiltin(args[0]) || func_exists(args[0])) { // a pipeline stage run by this copy of the shell
+            resumeSigchld(); // lrun or a function may wait for children of this copy
+            out_retarget();
+            is_a_tty = 0, active_foreground = 0;
+            exit(_callHere(args));
         }
+        execvp(args[0], args);
+        printError(args[0], 1); // execvp can fail
         exit(EXEC_FAILURE);
     } else if (child_pid > 0) {
         if (in != STDIN_FILENO) {
@@ -72,61 +185,36 @@ pid_t run_command(command *com, int in, int useless_in, int out, int bgjob, int
         if (bgjob) {
             newBgjob(child_pid);
         } else {
+            job_group(child_pid);
             active_foreground++;
         }
         return child_pid;
     } else {
-        fprintf(stderr, "%s\n", FORK_FAIL);
+        out_error("%s\n", FORK_FAIL);
         exit(EXEC_FAILURE);
     }
 }
 
-void run_pipeline(pipeline *ln) {
-    commandseq *commands = ln->commands;
-    int in = STDIN_FILENO;
-    int fd[2];
-    int bgjob = ln->flags & INBACKGROUND;
-    int call_builtins = 1;
-    while (commands->next != ln->commands) {
-        if (pipe(fd) < 0) {
-            fprintf(stderr, "%s\n", PIPE_FAIL);
-            exit(EXEC_FAILURE);
+int _properCommand(command *ln) { // redirections are not checked here, they are opened once when the pipeline starts
+    argseq *first = ln->args;
+    while (expand_isRedirection(first->arg)) {
+        first = first->next;
+        if (first == ln->args) {
+            return 1;
         }
-        call_builtins = 0;
-        run_command(commands->com, in, fd[0], fd[1], bgjob, call_builtins);
-        close(fd[1]);
-        in = fd[0];
-        commands = commands->next;
-    }
-    last_cmd_status = -1;
-    last_cmd_pid = run_command(commands->com, in, STDIN_FILENO, STDOUT_FILENO, bgjob, call_builtins);
-    while (active_foreground) { // wait for all children to die
-        sigsuspend(&EMPTY_SIGSET);
     }
-    if (!bgjob && is_a_tty && last_cmd_status != -1 && WIFSIGNALED(last_cmd_status) && WTERMSIG(last_cmd_status) == SIGINT) {
-        printf("\n");
+    if (first->arg[0] == FANOUT_MARK && first->arg[1] == '\0') {
+        return 1;
     }
-}
-
-int _properCommand(command *ln) {
-    if (!isExecutable(ln->args->arg) && !isBuiltin(ln->args->arg)) {
-        printError(ln->args->arg, 0);
+    if (expand_isPlain(first->arg) && !vars_assignment(first->arg) && !isExecutable(first->arg) && !isBuiltin(first->arg)
+        && !func_exists(first->arg)) {
+        printError(first->arg, 0);
         return 0;
     }
-    redirseq *ln_r = ln->redirs;
-    if (ln_r != NULL) {
-        do {
-            if (IS_RIN(ln_r->r->flags) && !isReadable(ln_r->r->filename)) {
-                printError(ln_r->r->filename, 0);
-                return 0;
-            }
-            ln_r = ln_r->next;
-        } while (ln_r != ln->redirs);
-    }
     return 1;
 }
 
-int _properPipeline(pipeline *ln) {
+int run_properPipeline(pipeline *ln) {
     commandseq *ln_p = ln->commands;
     int len = 0, empty = 0;
     do {
@@ -147,7 +235,7 @@ int _properPipeline(pipeline *ln) {
 int _properPipelineseq(pipelineseq *ln) {
     pipelineseq *ln_p = ln;
     do {
-        int r = _properPipeline(ln_p->pipeline);
+        int r = run_properPipeline(ln_p->pipeline);
         if (r == 2 || r == 0) {
             return r;
         }
@@ -156,17 +244,393 @@ int _properPipelineseq(pipelineseq *ln) {
     return 1;
 }
 
+typedef struct {
+    char **argv; // NULL for an empty command
+    redir_op *redirs;
+    int fanout; // the relay of "|>", its redirections are the consumers
+} _stage;
+
+static _stage *_expandPipeline(pipeline *ln, int *len, arena *a) { // before anything is spawned, substitutions run commands too
+    int i = 0;
+    commandseq *commands = ln->commands;
+    *len = 0;
+    do {
+        (*len)++;
+        commands = commands->next;
+    } while (commands != ln->commands);
+    _stage *stages = arena_alloc(a, *len * sizeof(_stage));
+    do {
+        stages[i].argv = NULL, stages[i].redirs = NULL;
+        if (commands->com != NULL) {
+            stages[i].argv = expand_command(commands->com, &stages[i].redirs, a);
+        }
+        char **argv = stages[i].argv;
+        if (argv != NULL && argv[0] == NULL && _readsInput(stages[i].redirs)) {
+            static char *copy[] = {"lcat", NULL};
+            stages[i].argv = argv = copy;
+        }
+        stages[i].fanout = (argv != NULL && argv[0] != NULL && argv[0][0] == FANOUT_MARK && argv[0][1] == '\0');
+        i++;
+        commands = commands->next;
+    } while (commands != ln->commands);
+    return stages;
+}
+
+static int _openPipeline(_stage *stages, int len) { // every file once, before anything runs
+    for (int i = 0; i < len; i++) {
+        if (!openRedirs(stages[i].redirs)) {
+            for (int j = 0; j < len; j++) { // later stages may hold process substitutions
+                closeRedirs(stages[j].redirs);
+            }
+            last_status = EXIT_FAILURE;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static pid_t _startRelay(redir_op *redirs, int in, int bgjob) { // copies in to every consumer, in is closed here
+    int n = 0;
+    for (redir_op *op = redirs; op != NULL; op = op->next) {
+        n += (op->mode == REDIR_KEEP);
+    }
+    int outs[n];
+    n = 0;
+    for (redir_op *op = redirs; op != NULL; op = op->next) {
+        if (op->mode == REDIR_KEEP) {
+            outs[n++] = op->src;
+        }
+    }
+    out_flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (bgjob) {
+            setsid();
+        } else {
+            job_group(0);
+        }
+        restoreSigactions();
+        exit(relay_run(in, outs, n));
+    } else if (pid < 0) {
+        out_error("%s\n", FORK_FAIL);
+        exit(EXEC_FAILURE);
+    }
+    close(in);
+    if (bgjob) {
+        newBgjob(pid);
+    } else {
+        job_group(pid);
+        active_foreground++;
+    }
+    return pid;
+}
+
+static const char *_stageName(_stage *s) {
+    return (s->fanout ? "|>" : s->argv[0] != NULL ? s->argv[0] : "-");
+}
+
+static int _startMeter(_stage *from, _stage *to, int in, int bgjob, int live) { // in goes through lmeter's relay, returns its output
+    int fd[2];
+    char label[PATH_MAX];
+    snprintf(label, sizeof(label), "%s|%s", _stageName(from), _stageName(to));
+    if (pipe(fd) < 0) {
+        out_error("%s\n", PIPE_FAIL);
+        exit(EXEC_FAILURE);
+    }
+    out_flush();
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (bgjob) {
+            setsid();
+        } else {
+            job_group(0);
+        }
+        restoreSigactions();
+        dup2(in, STDIN_FILENO);
+        dup2(fd[1], STDOUT_FILENO);
+        close_range(STDERR_FILENO + 1, ~0U, 0); // the pipes of the other stages must not stay open here
+        exit(relay_meter(STDIN_FILENO, STDOUT_FILENO, label, live));
+    } else if (pid < 0) {
+        out_error("%s\n", FORK_FAIL);
+        exit(EXEC_FAILURE);
+    }
+    close(in);
+    close(fd[1]);
+    if (bgjob) {
+        newBgjob(pid);
+    } else {
+        job_group(pid);
+        active_foreground++;
+    }
+    return fd[0];
+}
+
+static int _startPipeline(pipeline *ln, _stage *stages, int len, int out) {
+    if (!_openPipeline(stages, len)) {
+        return 0;
+    }
+    int in = STDIN_FILENO;
+    int fd[2];
+    int bgjob = ln->flags & INBACKGROUND;
+    int call_builtins = (len == 1 && !bgjob); // a job runs in a copy of the shell, like a function already did
+    int meter = (job_current != NULL ? job_current->meter : METER_OFF);
+    for (int i = 0; i < len - 1; i++) {
+        if (pipe(fd) < 0) {
+            out_error("%s\n", PIPE_FAIL);
+            exit(EXEC_FAILURE);
+        }
+        run_command(stages[i].redirs, stages[i].argv, in, fd[0], fd[1], bgjob, call_builtins);
+        close(fd[1]);
+        in = (meter != METER_OFF ? _startMeter(&stages[i], &stages[i + 1], fd[0], bgjob, meter == METER_LIVE) : fd[0]);
+    }
+    last_cmd_status = -1;
+    if (stages[len - 1].fanout) { // the consumers write to the shell's stdout themselves
+        last_cmd_pid = _startRelay(stages[len - 1].redirs, in, bgjob);
+    } else {
+        last_cmd_pid = run_command(stages[len - 1].redirs, stages[len - 1].argv, in, STDIN_FILENO, out, bgjob, call_builtins);
+    }
+    for (int i = 0; i < len; i++) {
+        closeRedirs(stages[i].redirs);
+    }
+    return 1;
+}
+
+void run_exec(char **args) { // replaces the shell, returns only if execvp failed
+    out_flush();
+    read_release();
+    if (is_a_tty) {
+        restoreTerm();
+    }
+    restoreSigactions();
+    execvp(args[0], args);
+    printError(args[0], 1);
+    resumeSigactions();
+}
+
+static int _canTailExec(pipeline *ln, _stage *stages, int len) { // one foreground external command and no jobs to wait for
+    char **argv = stages[0].argv;
+    if ((ln->flags & INBACKGROUND) || len != 1 || argv == NULL || argv[0] == NULL || isBuiltin(argv[0]) || func_exists(argv[0])
+        || vars_assignment(argv[0])) {
+        return 0;
+    }
+    processDeadChildren();
+    return countBgjobs(0) == 0;
+}
+
+static void _waitForeground() { // ppoll lets SIGCHLD in like sigsuspend does, and watches ltimeout's deadline
+    int timer = job_timerFd();
+    while (active_foreground) {
+        if (timer < 0) {
+            sigsuspend(&EMPTY_SIGSET);
+            continue;
+        }
+        struct pollfd pfd = {.fd = timer, .events = POLLIN};
+        if (ppoll(&pfd, 1, NULL, &EMPTY_SIGSET) > 0) {
+            job_expired();
+        }
+    }
+}
+
+void run_pipeline(pipeline *ln) {
+    int tail = _tail;
+    _tail = 0;
+    arena a;
+    arena_init(&a);
+    int len;
+    job_newPipeline(); // before the expansion, its <(...) belong to the pipeline
+    substs_len = 0;
+    _stage *stages = _expandPipeline(ln, &len, &a);
+    if (tail && _canTailExec(ln, stages, len)) { // saves the fork and the shell waiting around just to exit
+        if (openRedirs(stages[0].redirs) && applyRedirs(stages[0].redirs)) {
+            run_exec(stages[0].argv);
+        }
+        exit(EXEC_FAILURE);
+    }
+    int started = _startPipeline(ln, stages, len, STDOUT_FILENO);
+    arena_free(&a);
+    if (!started) {
+        return;
+    }
+    int bgjob = ln->flags & INBACKGROUND;
+    _waitForeground(); // wait for all children to die
+    if (bgjob || last_cmd_status == -1) {
+        last_status = EXEC_SUCCESS;
+    } else {
+        last_status = WIFEXITED(last_cmd_status) ? WEXITSTATUS(last_cmd_status) : SIGNAL_STATUS + WTERMSIG(last_cmd_status);
+    }
+    if (!bgjob && is_a_tty && last_cmd_status != -1 && WIFSIGNALED(last_cmd_status) && WTERMSIG(last_cmd_status) == SIGINT) {
+        out_write("\n", 1);
+    }
+}
+
+typedef struct {
+    char *data;
+    size_t len, size;
+} _capture_buf;
+
+static void _captureAppend(_capture_buf *b, const char *data, size_t len) {
+    if (b->len + len + 1 > b->size) {
+        b->size = max(2 * b->size, b->len + len + 1);
+        b->data = realloc(b->data, b->size);
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+}
+
+static void _captureBuiltin(_stage *stage, _capture_buf *b) { // in-process, stdout goes to memory
+    out_sink sink = {NULL, 0, 0};
+    if (!openRedirs(stage->redirs)) {
+        return;
+    }
+    out_sink *saved = out_capture(&sink);
+    _callBuiltin(stage->redirs, stage->argv);
+    out_capture(saved);
+    closeRedirs(stage->redirs);
+    if (sink.len > 0) { // nothing written leaves data NULL
+        _captureAppend(b, sink.data, sink.len);
+    }
+    free(sink.data);
+}
+
+static void _captureRead(int fd, _capture_buf *b, int until_eof, int others) { // fd is non-blocking
+    // others are foreground children that are not the capture's, like a <(...) of the same command
+    while (1) {
+        if (b->size - b->len < CAPTURE_READ + 1) {
+            b->size = max(2 * b->size, b->len + CAPTURE_READ + 1);
+            b->data = realloc(b->data, b->size);
+        }
+        ssize_t bytes_read = read(fd, b->data + b->len, b->size - b->len - 1);
+        if (bytes_read > 0) {
+            b->len += bytes_read;
+        } else if (bytes_read == 0) {
+            return;
+        } else if (errno == EAGAIN) {
+            if (!until_eof && active_foreground <= others) {
+                return;
+            }
+            ppoll(&(struct pollfd){.fd = fd, .events = POLLIN}, 1, NULL, &EMPTY_SIGSET); // SIGCHLD wakes us up too
+        } else if (errno != EINTR) {
+            out_error("%s\n", READ_FAIL);
+            return;
+        }
+    }
+}
+
+int run_processSubst(char *cmdline, int reading) { // <(...) when reading, else >(...); returns the outer command's end of the pipe
+    arena a;
+    arena_init(&a);
+    pipelineseq *ln = parse_line(cmdline, &a);
+    int r = (ln != NULL ? _properPipelineseq(ln) : 2);
+    int fd[2];
+    if (r != 1 || pipe2(fd, O_CLOEXEC) < 0) {
+        if (r == 2) {
+            out_error("%s\n", SYNTAX_ERROR_STR);
+        }
+        arena_free(&a);
+        return -1;
+    }
+    int inner = (reading ? fd[1] : fd[0]), outer = (reading ? fd[0] : fd[1]);
+    out_flush();
+    if (reading) { // the list keeps the shell's stdin
+        read_release();
+    }
+    pid_t pid = fork();
+    if (pid == 0) { // a copy of the shell runs the whole list, so it may be anything a line can be
+        job_group(0);
+        dup2(inner, reading ? STDOUT_FILENO : STDIN_FILENO);
+        close(fd[0]);
+        close(fd[1]);
+        out_retarget();
+        is_a_tty = 0, run_final = 0;
+        active_foreground = 0; // the shell's children are not ours
+        run_pipelineseq(ln);
+        exit(last_status);
+    } else if (pid < 0) {
+        out_error("%s\n", FORK_FAIL);
+        exit(EXEC_FAILURE);
+    }
+    job_group(pid);
+    active_foreground++; // waited for with the pipeline that uses it
+    if (substs_len == substs_size) {
+        substs_size = max(2 * substs_size, 8);
+        substs = realloc(substs, substs_size * sizeof(pid_t));
+    }
+    substs[substs_len++] = pid;
+    close(inner);
+    arena_free(&a);
+    if (outer < REDIR_FD_MIN) { // out of the way of numbered redirections
+        int high = fcntl(outer, F_DUPFD_CLOEXEC, REDIR_FD_MIN);
+        close(outer);
+        outer = high;
+    }
+    return outer;
+}
+
+pid_t *run_substs(int *len) { // for a builtin that runs the rest of its line under its own settings
+    *len = substs_len;
+    return substs;
+}
+
+char *run_capture(char *cmdline, size_t *len) {
+    _capture_buf b = {.data = NULL, .len = 0, .size = 0};
+    _captureAppend(&b, "", 0);
+    arena a;
+    arena_init(&a);
+    pipelineseq *ln = parse_line(cmdline, &a), *ln_p = ln;
+    int r = (ln != NULL ? _properPipelineseq(ln) : 2);
+    if (r == 2) {
+        out_error("%s\n", SYNTAX_ERROR_STR);
+    }
+    int fd[2] = {-1, -1};
+    while (r == 1) {
+        pipeline *p = ln_p->pipeline;
+        int len;
+        _stage *stages = _expandPipeline(p, &len, &a);
+        if (len == 1 && stages[0].argv != NULL && stages[0].argv[0] != NULL && isBuiltin(stages[0].argv[0])) {
+            _captureBuiltin(&stages[0], &b);
+        } else {
+            if (fd[0] == -1) {
+                if (pipe2(fd, O_CLOEXEC) < 0) {
+                    out_error("%s\n", PIPE_FAIL);
+                    exit(EXEC_FAILURE);
+                }
+                fcntl(fd[0], F_SETFL, O_NONBLOCK);
+            }
+            int others = active_foreground;
+            if (_startPipeline(p, stages, len, fd[1])) {
+                _captureRead(fd[0], &b, 0, others);
+            }
+        }
+        ln_p = ln_p->next;
+        if (ln_p == ln) {
+            break;
+        }
+    }
+    if (fd[0] != -1) {
+        close(fd[1]);
+        _captureRead(fd[0], &b, 1, 0);
+        close(fd[0]);
+    }
+    arena_free(&a);
+    b.data[b.len] = '\0';
+    *len = b.len;
+    return b.data;
+}
+
 void run_pipelineseq(pipelineseq *ln) {
     pipelineseq *ln_p = ln;
     int r = _properPipelineseq(ln);
     if (r == 2) { // empty string inside of pipeline
-        fprintf(stderr, "%s\n", SYNTAX_ERROR_STR);
+        out_error("%s\n", SYNTAX_ERROR_STR);
+        last_status = SYNTAX_STATUS;
         return;
     } else if (r == 0) {
+        last_status = EXEC_FAILURE;
         return;
     }
     do {
+        _tail = run_final && ln_p->next == ln;
         run_pipeline(ln_p->pipeline);
         ln_p = ln_p->next;
-    } while (ln_p != ln);
+    } while (ln_p != ln && !loop_break && !loop_continue && !func_return);
 }
@@ -0,0 +1,178 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "config.h"
+#include "mshell_serve.h"
+#include "my_utils.h"
+#include "out.h"
+#include "serve.h"
+
+typedef struct {
+    pid_t pid; // 0 for a free slot
+    int conn;  // the reply goes here once the worker is reaped
+} _worker;
+
+static int _listen(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    struct stat st;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode)) { // left over from an earlier server
+        unlink(path);
+    }
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        return -1;
+    }
+    return fd;
+}
+
+static int _applyEnv(char *env, size_t len) { // NAME=value sets, NAME alone unsets
+    for (char *p = env; p < env + len; p += strlen(p) + 1) {
+        char *eq = strchr(p, '=');
+        if (eq != NULL) {
+            *eq = '\0';
+        }
+        if (*p == '\0' || (eq != NULL ? setenv(p, eq + 1, 1) : unsetenv(p)) < 0) {
+            return 0;
+        }
+    }
+    ENV_PATH = getenv("PATH");
+    return 1;
+}
+
+static void _handle(int conn) { // in the worker, never returns
+    static char buf[SERVE_REQUEST_MAX + 2]; // room to NUL-terminate the command and the cwd
+    char control[CMSG_SPACE(MSHELL_SERVE_FDS * sizeof(int))];
+    struct iovec iov = {.iov_base = buf, .iov_len = SERVE_REQUEST_MAX};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control, .msg_controllen = sizeof(control)};
+    ssize_t len = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    int fds[MSHELL_SERVE_FDS], nfds = 0;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+            nfds = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(c), nfds * sizeof(int));
+        }
+    }
+    close(conn);
+    for (int i = 0; i < nfds; i++) { // in order, a passed descriptor may sit on a low number already
+        int fd = fcntl(fds[i], F_DUPFD_CLOEXEC, REDIR_FD_MIN);
+        close(fds[i]);
+        fds[i] = fd;
+    }
+    for (int i = 0; i < nfds; i++) {
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+    out_retarget();
+    mshell_serve_request req;
+    if (len < (ssize_t)sizeof(req) || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))) {
+        out_error("%s\n", SERVE_BAD_REQUEST);
+        exit(SYNTAX_STATUS);
+    }
+    memcpy(&req, buf, sizeof(req));
+    size_t body = (size_t)req.command_len + req.cwd_len + req.env_len;
+    if (req.version != MSHELL_SERVE_VERSION || body != (size_t)len - sizeof(req) || (req.env_len > 0 && buf[len - 1] != '\0')) {
+        out_error("%s\n", SERVE_BAD_REQUEST);
+        exit(SYNTAX_STATUS);
+    }
+    // NUL-terminates the command and the cwd in place, what follows each moves up
+    char *command = buf + sizeof(req), *cwd = command + req.command_len + 1, *env = cwd + req.cwd_len + 1;
+    memmove(env, command + req.command_len + req.cwd_len, req.env_len);
+    memmove(cwd, command + req.command_len, req.cwd_len);
+    command[req.command_len] = '\0';
+    cwd[req.cwd_len] = '\0';
+    if (req.cwd_len > 0 && chdir(cwd) < 0) {
+        printError(cwd, 0);
+        exit(EXIT_FAILURE);
+    }
+    if (!_applyEnv(env, req.env_len)) {
+        out_error("%s\n", SERVE_BAD_REQUEST);
+        exit(SYNTAX_STATUS);
+    }
+    unblockSigchld();
+    cache_runString(command);
+    exit(EXEC_FAILURE);
+}
+
+static void _reply(_worker *w, int status, const struct rusage *usage) {
+    mshell_serve_reply reply = {
+        .status = WIFEXITED(status) ? WEXITSTATUS(status) : SIGNAL_STATUS + WTERMSIG(status),
+        .user_us = usage->ru_utime.tv_sec * 1000000LL + usage->ru_utime.tv_usec,
+        .sys_us = usage->ru_stime.tv_sec * 1000000LL + usage->ru_stime.tv_usec,
+        .maxrss_kb = usage->ru_maxrss,
+    };
+    send(w->conn, &reply, sizeof(reply), MSG_NOSIGNAL); // the client may be gone, nothing to do then
+    close(w->conn);
+    w->pid = 0;
+}
+
+void serve_run(const char *path, int max) {
+    int sock = _listen(path);
+    if (sock < 0) {
+        out_error("%s %s: %s\n", SERVE_FAIL, path, strerror(errno));
+        exit(EXEC_FAILURE);
+    }
+    _worker *workers = calloc(max, sizeof(_worker));
+    int running = 0, tag = newBgjobTag();
+    setBgjobTag(tag); // workers are background jobs of their own tag, the handler records how they ended
+    blockSigchld();
+    while (1) {
+        pid_t pid;
+        int status, t;
+        struct rusage usage;
+        while ((pid = takeFinishedBgjob(tag, &t, &status, &usage)) > 0) {
+            for (int i = 0; i < max; i++) {
+                if (workers[i].pid == pid) {
+                    _reply(&workers[i], status, &usage);
+                    running--;
+                }
+            }
+        }
+        struct pollfd pfd = {.fd = sock, .events = (running < max ? POLLIN : 0)};
+        if (ppoll(&pfd, 1, NULL, &EMPTY_SIGSET) <= 0 || !(pfd.revents & POLLIN)) {
+            continue; // SIGCHLD, a worker is done
+        }
+        int conn = accept4(sock, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0) {
+            continue;
+        }
+        int slot = 0;
+        while (workers[slot].pid != 0) {
+            slot++;
+        }
+        out_flush();
+        pid = fork();
+        if (pid == 0) {
+            close(sock);
+            for (int i = 0; i < max; i++) {
+                if (workers[i].pid != 0) {
+                    close(workers[i].conn);
+                }
+            }
+            setBgjobTag(0);
+            _handle(conn);
+        } else if (pid < 0) {
+            out_error("%s\n", FORK_FAIL);
+            close(conn);
+            continue;
+        }
+        newBgjob(pid);
+        workers[slot] = (_worker){.pid = pid, .conn = conn};
+        running++;
+    }
+}
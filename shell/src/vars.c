@@ -0,0 +1,139 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "run.h"
+#include "vars.h"
+
+/*
+ * Shell variables live in a chained hash table; lookups fall back to the environment.
+ * $0 and the positional parameters are kept apart, as pointers to words their owner
+ * keeps alive: the command line for a script, the expanded call for a function.
+ */
+
+typedef struct var var;
+
+struct var {
+    char *name, *value;
+    var *next;
+};
+
+var *vars_table[VARS_BUCKETS];
+static char *arg0 = "mshell";
+static char **params = (char *[]){NULL}; // $1 and on
+
+static char *_joinParams() { // $@ and $*, split again like any other value
+    static char *joined = NULL;
+    size_t len = 0;
+    for (int i = 0; params[i] != NULL; i++) {
+        len += strlen(params[i]) + 1;
+    }
+    free(joined);
+    joined = malloc(len + 1);
+    joined[0] = '\0';
+    for (int i = 0; params[i] != NULL; i++) {
+        strcat(joined, i > 0 ? " " : "");
+        strcat(joined, params[i]);
+    }
+    return joined;
+}
+
+static char *_param(const char *name) { // $0, $1... and ${10}..., NULL past the last one
+    long n = strtol(name, NULL, 10);
+    if (n == 0) {
+        return arg0;
+    }
+    for (long i = 0; i < n - 1; i++) {
+        if (params[i] == NULL) {
+            return NULL;
+        }
+    }
+    return params[n - 1];
+}
+
+static unsigned _hash(const char *name, int len) {
+    unsigned h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return h % VARS_BUCKETS;
+}
+
+static var *_find(const char *name, int len) {
+    for (var *v = vars_table[_hash(name, len)]; v != NULL; v = v->next) {
+        if (strncmp(v->name, name, len) == 0 && v->name[len] == '\0') {
+            return v;
+        }
+    }
+    return NULL;
+}
+
+char *vars_get(const char *name) {
+    static char special[32];
+    if (strcmp(name, "?") == 0) {
+        snprintf(special, sizeof(special), "%d", last_status);
+        return special;
+    }
+    if (strcmp(name, "$") == 0) {
+        snprintf(special, sizeof(special), "%d", getpid());
+        return special;
+    }
+    if (strcmp(name, "#") == 0) {
+        snprintf(special, sizeof(special), "%d", getNullPos(params));
+        return special;
+    }
+    if (strcmp(name, "@") == 0 || strcmp(name, "*") == 0) {
+        return _joinParams();
+    }
+    if (isdigit((unsigned char)name[0])) {
+        return _param(name);
+    }
+    var *v = _find(name, strlen(name));
+    return v != NULL ? v->value : getenv(name);
+}
+
+void vars_setArgs(char **args) { // $0 and then $1 and on, from the shell's own command line
+    arg0 = args[0];
+    params = args + 1;
+}
+
+char **vars_swapParams(char **new) { // returns the ones to put back
+    char **old = params;
+    params = new;
+    return old;
+}
+
+void vars_set(const char *name, const char *value) {
+    int len = strlen(name);
+    var *v = _find(name, len);
+    if (v == NULL) {
+        unsigned h = _hash(name, len);
+        v = malloc(sizeof(var));
+        v->name = strdup(name);
+        v->value = NULL;
+        v->next = vars_table[h];
+        vars_table[h] = v;
+    }
+    free(v->value);
+    v->value = strdup(value);
+}
+
+int vars_isName(const char *str, int len) {
+    if (len <= 0 || !(isalpha((unsigned char)str[0]) || str[0] == '_')) {
+        return 0;
+    }
+    for (int i = 1; i < len; i++) {
+        if (!(isalnum((unsigned char)str[i]) || str[i] == '_')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int vars_assignment(const char *word) { // length of the name in "name=value", 0 if it is not an assignment
+    const char *eq = strchr(word, '=');
+    return eq != NULL && vars_isName(word, eq - word) ? eq - word : 0;
+}
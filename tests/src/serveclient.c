@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "mshell_serve.h"
+
+#define ENV_MAX 4096
+
+int
+main(int argc, char* argv[])
+{
+	struct sockaddr_un addr = {.sun_family = AF_UNIX};
+	mshell_serve_request req = {.version = MSHELL_SERVE_VERSION};
+	mshell_serve_reply reply;
+	char env[ENV_MAX];
+	char *cwd = "";
+	int fd, n, fds[MSHELL_SERVE_FDS] = {0, 1, 2};
+
+	for (n=1; n+1 < argc && argv[n][0] == '-'; n+=2){
+		if (strcmp(argv[n], "-d") == 0) {
+			cwd = argv[n+1];
+		} else if (strcmp(argv[n], "-e") == 0 && req.env_len + strlen(argv[n+1]) < ENV_MAX) {
+			strcpy(env + req.env_len, argv[n+1]);
+			req.env_len += strlen(argv[n+1]) + 1;
+		} else {
+			break;
+		}
+	}
+	if (argc - n != 2) {
+		printf("Syntax: %s [-d dir] [-e name=value]... socket commands\n", argv[0]);
+		return 1;
+	}
+
+	strncpy(addr.sun_path, argv[n], sizeof(addr.sun_path) - 1);
+	fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		perror("connect");
+		return 1;
+	}
+
+	req.command_len = strlen(argv[n+1]);
+	req.cwd_len = strlen(cwd);
+	struct iovec iov[4] = {{&req, sizeof(req)}, {argv[n+1], req.command_len}, {cwd, req.cwd_len}, {env, req.env_len}};
+	char control[CMSG_SPACE(sizeof(fds))];
+	struct msghdr msg = {.msg_iov = iov, .msg_iovlen = 4, .msg_control = control, .msg_controllen = sizeof(control)};
+	struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+	c->cmsg_level = SOL_SOCKET;
+	c->cmsg_type = SCM_RIGHTS;
+	c->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(c), fds, sizeof(fds));
+
+	if (sendmsg(fd, &msg, 0) < 0 || recv(fd, &reply, sizeof(reply), 0) != sizeof(reply)) {
+		perror("request");
+		return 1;
+	}
+
+	printf("status %d\n", reply.status);
+	return 0;
+}